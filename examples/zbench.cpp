@@ -0,0 +1,385 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "zbench.h"
+
+#include <zstream.h>
+
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// every operator new of the process is counted
+static std::atomic<zconf::uint64> allocations( 0 );
+
+void *operator new( std::size_t size ){
+	allocations++;
+	void *pointer = std::malloc( size ? size : 1 );
+	if( pointer == 0 ) throw std::bad_alloc();
+	return pointer;
+}
+
+void *operator new[]( std::size_t size ){
+	return operator new( size );
+}
+
+void operator delete( void *pointer ) noexcept{
+	std::free( pointer );
+}
+
+void operator delete[]( void *pointer ) noexcept{
+	std::free( pointer );
+}
+
+// words of the text corpus
+static const char *words[] = {
+	"zip", "stream", "archive", "entry", "deflate", "inflate", "buffer", "offset",
+	"the", "of", "a", "to", "and", "in", "is", "it", "central", "directory",
+	"local", "header", "record", "data", "descriptor", "crc", "size", "method"
+};
+
+static const zconf::uint64 nwords = sizeof( words ) / sizeof( words[0] );
+
+zbench::zbench( const std::string &directory, zconf::uint32 scale ) :
+	_tiny_path( directory + "/zbench_tiny.zip" ), _huge_path( directory + "/zbench_huge.zip" ),
+	_tiny_bytes( 0 ), _tiny_count( 20000 * scale ), _huge_size( ( 16 << 20 ) * zconf::uint64( scale ) ),
+	_seed( 0x9e3779b97f4a7c15ULL ), _allocs( 0 ){
+}
+
+zbench::~zbench(){
+}
+
+void zbench::print_usage( void ){
+	std::cout << "zstream & ziparchive benchmarks, one json line per case"         << std::endl;
+	std::cout << std::endl << "zipstream_bench [options] [directory]"              << std::endl;
+	std::cout << std::endl << "options:"                                           << std::endl;
+	std::cout              << "   -s scale the corpus by n ( 1 by default )"       << std::endl;
+	std::cout << std::endl << "the corpus is written to the directory and removed at the end" << std::endl;
+}
+
+int zbench::main( int argc, char *argv[] ){
+	std::string directory = ".";
+	zconf::uint32 scale = 1;
+	// get arguments
+	for( int narg = 1; narg < argc; narg++ ){
+		std::string option = argv[narg];
+		if( !option.compare( "-s" ) && narg + 1 < argc ){
+			scale = std::atoi( argv[++narg] );
+			if( scale == 0 ){
+				print_usage(); return 1;
+			}
+		}else if( !option.compare( 0, 1, "-" ) ){
+			print_usage(); return 1;
+		}else{
+			directory = option;
+		}
+	}
+	zbench bench( directory, scale );
+	return bench.run() ? 0 : 1;
+}
+
+bool zbench::run( void ){
+	bool done = write_tiny() && open_archive() && lookup();
+	// thread scaling of the reads
+	for( zconf::uint32 threads = 1; done && threads <= 8; threads *= 2 ){
+		done = read_tiny( false, threads );
+	}
+	done = done && read_tiny( true, 1 );
+	// the parallel deflate replaces the text entries
+	zconf::uint32 cores = std::max( 2u, std::thread::hardware_concurrency() );
+	done = done && write_huge( true, 1 ) && write_huge( false, 1 ) && write_huge( true, cores );
+	done = done && read_huge( true, false ) && read_huge( false, false );
+	done = done && read_huge( true, true ) && read_huge( false, true );
+	done = done && read_huge( true, false, ZCAHEAD ) && read_huge( false, false, ZCAHEAD );
+	// thread scaling of the inflate throughput
+	for( zconf::uint32 threads = 1; done && threads <= 8; threads *= 2 ){
+		done = read_shared( threads );
+	}
+	done = done && fill_gaps();
+	std::remove( _tiny_path.c_str() );
+	std::remove( _huge_path.c_str() );
+	return done;
+}
+
+zconf::uint64 zbench::next( void ){
+	_seed ^= _seed >> 12; _seed ^= _seed << 25; _seed ^= _seed >> 27;
+	return _seed * 0x2545f4914f6cdd1dULL;
+}
+
+void zbench::make_data( std::string &data, zconf::uint64 size, bool text ){
+	data.clear();
+	data.reserve( size );
+	if( text ){
+		// words & lines, about 3:1 with deflate
+		while( data.size() < size ){
+			zconf::uint64 random = next();
+			data.append( words[ random % nwords ] );
+			data.push_back( ( random >> 32 ) % 12 ? ' ' : '\n' );
+		}
+		data.resize( size );
+	}else{
+		// incompressible bytes
+		while( data.size() < size ){
+			zconf::uint64 random = next();
+			data.append( reinterpret_cast<const char *>( &random ),
+				std::min<zconf::uint64>( sizeof( random ), size - data.size() ) );
+		}
+	}
+}
+
+void zbench::start( void ){
+	_allocs = allocations;
+	_start = std::chrono::steady_clock::now();
+}
+
+void zbench::report( const std::string &name, zconf::uint32 threads, zconf::uint64 ops, zconf::uint64 bytes ){
+	double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - _start ).count();
+	zconf::uint64 allocs = allocations - _allocs;
+	if( seconds <= 0 ) seconds = 1e-9;
+	std::printf( "{\"case\":\"%s\",\"threads\":%u,\"ops\":%llu,\"bytes\":%llu,\"seconds\":%.6f,"
+		"\"mb_s\":%.2f,\"entries_s\":%.1f,\"allocs_per_op\":%.3f}\n",
+		name.c_str(), threads, (unsigned long long) ops, (unsigned long long) bytes, seconds,
+		bytes / seconds / ( 1 << 20 ), ops / seconds, ops ? double( allocs ) / ops : 0.0 );
+	std::fflush( stdout );
+}
+
+void zbench::report_stats( const std::string &name, const zstats &stats ){
+#ifdef ZSTATS
+	std::printf( "{\"case\":\"%s\",\"streams\":%llu,\"bytes_in\":%llu,\"bytes_out\":%llu,"
+		"\"inflates\":%llu,\"deflates\":%llu,\"zlib_ns\":%llu,\"io_ns\":%llu,\"seeks\":%llu,\"refills\":%llu,"
+		"\"lookup_p50_ns\":%llu,\"lookup_p99_ns\":%llu,\"open_p50_ns\":%llu,\"open_p99_ns\":%llu}\n",
+		( name + ".stats" ).c_str(), (unsigned long long) stats.streams,
+		(unsigned long long) stats.bytes_in, (unsigned long long) stats.bytes_out,
+		(unsigned long long) stats.inflates, (unsigned long long) stats.deflates,
+		(unsigned long long) stats.zlib_ns, (unsigned long long) stats.io_ns,
+		(unsigned long long) stats.seeks, (unsigned long long) stats.refills,
+		(unsigned long long) stats.lookup_ns.percentile( 0.5 ), (unsigned long long) stats.lookup_ns.percentile( 0.99 ),
+		(unsigned long long) stats.open_ns.percentile( 0.5 ), (unsigned long long) stats.open_ns.percentile( 0.99 ) );
+	std::fflush( stdout );
+#else
+	(void) name; (void) stats;
+#endif
+}
+
+bool zbench::fail( const std::string &name, const std::string &error ){
+	std::cerr << "error: " << name << ": " << error << std::endl;
+	return false;
+}
+
+bool zbench::write_tiny( void ){
+	std::remove( _tiny_path.c_str() );
+	// sizes from 64 bytes to 2 KB
+	_tiny_names.clear(); _tiny_sizes.clear(); _tiny_bytes = 0;
+	std::vector<std::string> contents( _tiny_count );
+	for( zconf::uint64 i = 0; i < _tiny_count; i++ ){
+		_tiny_names.push_back( "tiny/" + std::to_string( i ) + ".txt" );
+		make_data( contents[i], 64 + next() % 1984, true );
+		_tiny_sizes.push_back( contents[i].size() );
+		_tiny_bytes += contents[i].size();
+	}
+	start();
+	ziparchive zip( _tiny_path.c_str(), ziparchive::fcreate );
+	for( zconf::uint64 i = 0; i < _tiny_count; i++ ){
+		zipentry *entry = zip.entry( _tiny_names[i], 0, zstream::fwio );
+		if( entry == 0 ) return fail( "write_tiny", zip.error() );
+		entry->write( &contents[i][0], contents[i].size() );
+		entry->close();
+	}
+	if( !zip.close().error().empty() ) return fail( "write_tiny", zip.error() );
+	report( "write_tiny", 1, _tiny_count, _tiny_bytes );
+	report_stats( "write_tiny", zip.stats() );
+	return true;
+}
+
+bool zbench::write_huge( bool text, zconf::uint32 threads ){
+	std::string name = std::string( "write_huge_" ) + ( text ? "text" : "random" );
+	std::vector<std::string> contents( 2 );
+	for( zconf::uint32 i = 0; i < contents.size(); i++ ){
+		make_data( contents[i], _huge_size, text );
+	}
+	start();
+	ziparchive zip( _huge_path.c_str(), ziparchive::fcreate );
+	for( zconf::uint32 i = 0; i < contents.size(); i++ ){
+		std::string entrystr = ( text ? "text/" : "random/" ) + std::to_string( i );
+		zipentry *entry = zip.entry( entrystr, 0, zstream::fwio );
+		if( entry == 0 ) return fail( name, zip.error() );
+		if( threads > 1 ) entry->setthreads( threads );
+		// by chunks of an output buffer
+		for( zconf::uint64 offset = 0; offset < _huge_size; offset += ZCOBSIZE ){
+			entry->write( &contents[i][ offset ], std::min<zconf::uint64>( ZCOBSIZE, _huge_size - offset ) );
+		}
+		if( entry->flags() & zstream::ferr ) return fail( name, entry->error() );
+		entry->close();
+	}
+	if( !zip.close().error().empty() ) return fail( name, zip.error() );
+	report( name, threads, contents.size(), contents.size() * _huge_size );
+	report_stats( name, zip.stats() );
+	return true;
+}
+
+bool zbench::open_archive( void ){
+	const zconf::uint32 repeats = 8;
+	start();
+	for( zconf::uint32 i = 0; i < repeats; i++ ){
+		ziparchive zip( _tiny_path.c_str() );
+		if( !zip.is_open() ) return fail( "open", zip.error() );
+	}
+	// measured by entry of the central directory
+	report( "open", 1, repeats * _tiny_count, 0 );
+	return true;
+}
+
+bool zbench::lookup( void ){
+	ziparchive zip( _tiny_path.c_str() );
+	if( !zip.is_open() ) return fail( "lookup", zip.error() );
+	// random order
+	std::vector<std::string> names( _tiny_names );
+	for( zconf::uint64 i = names.size(); i > 1; i-- ){
+		std::swap( names[ i - 1 ], names[ next() % i ] );
+	}
+	const zconf::uint32 repeats = 8;
+	zconf::uint64 bytes = 0;
+	start();
+	for( zconf::uint32 r = 0; r < repeats; r++ ){
+		for( zconf::uint64 i = 0; i < names.size(); i++ ){
+			bytes += zip.uncompressed_size( names[i] );
+		}
+	}
+	report( "lookup", 1, repeats * names.size(), 0 );
+	if( bytes != repeats * _tiny_bytes ) return fail( "lookup", "wrong sizes" );
+	return true;
+}
+
+bool zbench::read_tiny( bool mapped, zconf::uint32 threads ){
+	std::string name = mapped ? "read_tiny_map" : "read_tiny";
+	ziparchive zip( _tiny_path.c_str(), mapped ? ziparchive::fmap : 0 );
+	if( !zip.is_open() ) return fail( name, zip.error() );
+	std::atomic<zconf::uint64> bytes( 0 ), failed( 0 );
+	start();
+	// every thread reads every n-th entry
+	std::vector<std::thread> workers;
+	for( zconf::uint32 t = 0; t < threads; t++ ){
+		workers.push_back( std::thread( [&, t](){
+			std::string data;
+			for( zconf::uint64 i = t; i < _tiny_names.size(); i += threads ){
+				if( zip.read( _tiny_names[i], data ) ) bytes += data.size();
+				else failed++;
+			}
+		} ) );
+	}
+	for( zconf::uint32 t = 0; t < workers.size(); t++ ){
+		workers[t].join();
+	}
+	report( name, threads, _tiny_names.size(), bytes );
+	report_stats( name, zip.stats() );
+	if( failed || bytes != _tiny_bytes ) return fail( name, zip.error() );
+	return true;
+}
+
+bool zbench::read_huge( bool text, bool mapped, zconf::uint32 depth ){
+	std::string name = std::string( "read_huge_" ) + ( text ? "text" : "random" ) + ( mapped ? "_map" : "" ) +
+		( depth ? "_ahead" : "" );
+	ziparchive zip( _huge_path.c_str(), mapped ? ziparchive::fmap : 0 );
+	if( !zip.is_open() ) return fail( name, zip.error() );
+	std::string buffer( ZCOBSIZE, 0 );
+	zconf::uint64 bytes = 0;
+	start();
+	for( zconf::uint32 i = 0; i < 2; i++ ){
+		zipentry *entry = zip.entry( ( text ? "text/" : "random/" ) + std::to_string( i ) );
+		if( entry == 0 ) return fail( name, "entry not found" );
+		if( depth > 0 ) entry->setreadahead( depth );
+		// by chunks of an output buffer
+		while( !entry->eof() && !( entry->flags() & zstream::ferr ) ){
+			entry->read( &buffer[0], buffer.size() );
+			bytes += entry->gcount();
+		}
+		if( entry->flags() & zstream::ferr ) return fail( name, entry->error() );
+		entry->close();
+	}
+	report( name, 1, 2, bytes );
+	report_stats( name, zip.stats() );
+	if( bytes != 2 * _huge_size ) return fail( name, "wrong size" );
+	return true;
+}
+
+bool zbench::read_shared( zconf::uint32 threads ){
+	std::string name = "read_huge_threads";
+	ziparchive zip( _huge_path.c_str() );
+	if( !zip.is_open() ) return fail( name, zip.error() );
+	std::atomic<zconf::uint64> bytes( 0 ), failed( 0 );
+	start();
+	// every thread inflates both text entries through the same archive
+	std::vector<std::thread> workers;
+	for( zconf::uint32 t = 0; t < threads; t++ ){
+		workers.push_back( std::thread( [&](){
+			std::string buffer( ZCOBSIZE, 0 );
+			for( zconf::uint32 i = 0; i < 2; i++ ){
+				zipentry *entry = zip.entry( "text/" + std::to_string( i ) );
+				if( entry == 0 ){
+					failed++; continue;
+				}
+				while( !entry->eof() && !( entry->flags() & zstream::ferr ) ){
+					entry->read( &buffer[0], buffer.size() );
+					bytes += entry->gcount();
+				}
+				if( entry->flags() & zstream::ferr ) failed++;
+				entry->close();
+			}
+		} ) );
+	}
+	for( zconf::uint32 t = 0; t < workers.size(); t++ ){
+		workers[t].join();
+	}
+	report( name, threads, 2 * threads, bytes );
+	report_stats( name, zip.stats() );
+	if( failed || bytes != 2 * threads * _huge_size ) return fail( name, zip.error() );
+	return true;
+}
+
+bool zbench::fill_gaps( void ){
+	ziparchive zip( _tiny_path.c_str() );
+	if( !zip.is_open() ) return fail( "fill_gaps", zip.error() );
+	// an entry of half the size of the first one replaces every couple of removed entries
+	std::vector<std::string> contents;
+	zconf::uint64 bytes = 0;
+	for( zconf::uint64 i = 1; i + 1 < _tiny_names.size(); i += 4 ){
+		contents.push_back( std::string() );
+		make_data( contents.back(), _tiny_sizes[i] / 2, true );
+		bytes += contents.back().size();
+	}
+	start();
+	for( zconf::uint64 i = 1; i + 1 < _tiny_names.size(); i += 4 ){
+		zip.remove( _tiny_names[i] ).remove( _tiny_names[ i + 1 ] );
+	}
+	// the reserved space ( stored blocks at worst ) takes the best fitting gap
+	for( zconf::uint64 i = 1, n = 0; i + 1 < _tiny_names.size(); i += 4, n++ ){
+		zconf::uint64 reserve = contents[n].size() + 64;
+		zipentry *entry = zip.entry( _tiny_names[i], reserve, zstream::fwio );
+		if( entry == 0 ) return fail( "fill_gaps", zip.error() );
+		entry->write( &contents[n][0], contents[n].size() );
+		entry->close();
+	}
+	if( !zip.close().error().empty() ) return fail( "fill_gaps", zip.error() );
+	report( "fill_gaps", 1, contents.size(), bytes );
+	return true;
+}
+
+int main( int argc, char *argv[] ){
+	return zbench::main( argc, argv );
+}
@@ -0,0 +1,90 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ZBENCH_H_
+#define ZBENCH_H_
+
+#include <ziparchive.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+class zbench{
+
+public:
+	// constructor, the corpus is scale times the default one
+	zbench( const std::string &directory, zconf::uint32 scale );
+	// destructor
+	virtual ~zbench();
+	// main entry
+	static int main( int argc, char *argv[] );
+	// run every case, false if any of them failed
+	bool run( void );
+
+private:
+	// print options
+	static void print_usage( void );
+	// deterministic pseudo random numbers ( xorshift64* )
+	zconf::uint64 next( void );
+	// fill data with text or incompressible bytes
+	void make_data( std::string &data, zconf::uint64 size, bool text );
+	// case: write many tiny entries
+	bool write_tiny( void );
+	// case: write a few huge entries
+	bool write_huge( bool text, zconf::uint32 threads );
+	// case: open the archive & read its central directory
+	bool open_archive( void );
+	// case: look up every entry by name
+	bool lookup( void );
+	// case: read every tiny entry with n threads
+	bool read_tiny( bool mapped, zconf::uint32 threads );
+	// case: read the huge entries by chunks ( reading the compressed data ahead )
+	bool read_huge( bool text, bool mapped, zconf::uint32 depth = 0 );
+	// case: inflate the huge text entries from n threads sharing the archive
+	bool read_shared( zconf::uint32 threads );
+	// case: replace couples of tiny entries by smaller ones, they take the freed gaps
+	bool fill_gaps( void );
+	// start the clock & the allocation counter
+	void start( void );
+	// print a json line with the measures since start
+	void report( const std::string &name, zconf::uint32 threads,
+		zconf::uint64 ops, zconf::uint64 bytes );
+	// print a json line with the counters of an archive ( builds with ZSTATS )
+	void report_stats( const std::string &name, const zstats &stats );
+	// print an error
+	bool fail( const std::string &name, const std::string &error );
+
+private:
+	// paths of the corpus archives
+	std::string _tiny_path;
+	std::string _huge_path;
+	// names & sizes of the tiny entries
+	std::vector<std::string> _tiny_names;
+	std::vector<zconf::uint64> _tiny_sizes;
+	zconf::uint64 _tiny_bytes;
+	// number of tiny entries & size of every huge entry
+	zconf::uint64 _tiny_count;
+	zconf::uint64 _huge_size;
+	// generator state
+	zconf::uint64 _seed;
+	// measures
+	std::chrono::steady_clock::time_point _start;
+	zconf::uint64 _allocs;
+
+};
+
+#endif //ZBENCH_H_
@@ -19,6 +19,21 @@
 #include <zstream.h>
 
 #include <sstream>
+#include <algorithm>
+#include <thread>
+#include <cstdlib>
+
+#ifdef _WIN32
+	#include <direct.h>
+	#include <io.h>
+	#include <fcntl.h>
+	#include <sys/stat.h>
+#else
+	#include <sys/stat.h>
+	#include <sys/types.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
 
 zippy *zippy::_instance = 0;
 
@@ -39,6 +54,13 @@ int zippy::main( int argc, char*argv[] ){
 	std::string zip_file = "";
 	bool extract_all     = false;
 	bool print_entries   = false;
+	bool map_archive     = false;
+	bool import_entry    = false;
+	bool defrag_archive  = false;
+	bool remove_entry    = false;
+	std::string directory = "";
+	std::string merge_file = "";
+	zconf::uint32 threads = 0;
 
 	// get arguments
 	if( argc == 1 ){
@@ -47,8 +69,26 @@ int zippy::main( int argc, char*argv[] ){
 
 	for( int narg=2;narg<=argc;narg++ ){
 		if( std::string( argv[narg-1] ).length() > 1 && !std::string( argv[narg-1] ).substr(0,1).compare( "-" ) ){
-			for( int nsarg=1;nsarg<std::string( argv[narg-1] ).length();nsarg++ ){
-				if( !std::string( argv[narg-1] ).substr(nsarg,nsarg).compare( "a" ) ){
+			std::string option = argv[narg-1];
+			for( size_t nsarg=1;nsarg<option.length();nsarg++ ){
+				if( !option.substr(nsarg,1).compare( "j" ) || !option.substr(nsarg,1).compare( "o" ) ||
+					!option.substr(nsarg,1).compare( "c" ) ){
+					// the value is the next argument
+					if( narg >= argc - 1 ){
+						print_usage(); return 1;
+					}
+					if( !option.substr(nsarg,1).compare( "j" ) ){
+						threads = std::atoi( argv[narg] );
+						if( threads == 0 ){
+							print_usage(); return 1;
+						}
+					}else if( !option.substr(nsarg,1).compare( "c" ) ){
+						merge_file = argv[narg];
+					}else{
+						directory = argv[narg];
+					}
+					narg++; break;
+				}else if( !std::string( argv[narg-1] ).substr(nsarg,nsarg).compare( "a" ) ){
 					if( zip.is_open() || print_entries ){
 						print_usage(); return 1;
 					}
@@ -58,6 +98,23 @@ int zippy::main( int argc, char*argv[] ){
 						print_usage(); return 1;
 					}
 					print_entries = true;
+				}else if( !std::string( argv[narg-1] ).substr(nsarg,nsarg).compare( "m" ) ){
+					map_archive = true;
+				}else if( !std::string( argv[narg-1] ).substr(nsarg,nsarg).compare( "i" ) ){
+					if( zip.is_open() || print_entries || extract_all ){
+						print_usage(); return 1;
+					}
+					import_entry = true;
+				}else if( !std::string( argv[narg-1] ).substr(nsarg,nsarg).compare( "d" ) ){
+					if( zip.is_open() || print_entries || extract_all || import_entry ){
+						print_usage(); return 1;
+					}
+					defrag_archive = true;
+				}else if( !std::string( argv[narg-1] ).substr(nsarg,nsarg).compare( "r" ) ){
+					if( zip.is_open() || print_entries || extract_all || import_entry || defrag_archive ){
+						print_usage(); return 1;
+					}
+					remove_entry = true;
 				}else{
 					std::cerr << "invalid argument: ";
 					std::cerr << std::string( argv[narg-1] ).substr(nsarg,nsarg) << std::endl;
@@ -65,12 +122,12 @@ int zippy::main( int argc, char*argv[] ){
 				}
 			}
 		}else if( narg+1 == argc ){
-			if( print_entries || extract_all ){
+			if( print_entries || extract_all || defrag_archive ){
 				print_usage(); return 1;
 			}
 			zip_file = argv[narg-1];
 		}else if( narg == argc ){
-			if( print_entries || extract_all ){
+			if( ( print_entries || extract_all || defrag_archive || !merge_file.empty() ) && zip_file.empty() ){
 				zip_file = argv[narg-1];
 			}else{
 				entry = argv[narg-1];
@@ -82,8 +139,13 @@ int zippy::main( int argc, char*argv[] ){
 		}
 	}
 
+	// imports create the archive
+	if( ( import_entry || remove_entry ) && ( map_archive || entry.empty() ) ){
+		print_usage(); return 1;
+	}
+	zconf::uint32 flags = map_archive ? ziparchive::fmap : ( import_entry ? ziparchive::fcreate : 0 );
 	// check if the zip was found
-	if( !zip.open( zip_file.c_str() ).is_open() ){
+	if( !zip.open( zip_file.c_str(), flags ).is_open() ){
 		std::cerr << "error: the zip file wasn't found, it's corrupted or it's not compatible" << std::endl;
 		return 1;
 	}else{
@@ -98,6 +160,11 @@ int zippy::main( int argc, char*argv[] ){
 			}else{
 				std::cout << zip.error() << std::endl;
 			}
+		}else if( extract_all && ( threads > 0 || !directory.empty() ) ){
+			// extract entries to files
+			if( !extract_directory( directory.empty() ? "." : directory, threads > 0 ? threads : 1 ) ){
+				return 1;
+			}
 		}else if( extract_all ){
 			if( zip.is_open() ){
 				std::vector<std::string> entries = zip.entries();
@@ -109,6 +176,24 @@ int zippy::main( int argc, char*argv[] ){
 			}else{
 				std::cout << zip.error() << std::endl;
 			}
+		}else if( !merge_file.empty() ){
+			// copy the entries as they are
+			if( !merge( merge_file, entry ) ) return 1;
+		}else if( defrag_archive ){
+			// compact the entries & write the central directory
+			if( !zip.defrag().close().error().empty() ){
+				std::cerr << zip.error() << std::endl;
+				return 1;
+			}
+		}else if( remove_entry ){
+			// the central directory is written on closing
+			if( !zip.remove( entry ).close().error().empty() ){
+				std::cerr << zip.error() << std::endl;
+				return 1;
+			}
+		}else if( import_entry ){
+			// read the entry from the standard input
+			if( !import_stdin( entry, threads ) ) return 1;
 		}else if( !entry.empty() ){
 			extract_entry( entry );
 		}
@@ -117,12 +202,10 @@ int zippy::main( int argc, char*argv[] ){
 	return 0;
 }
 
-zippy::zippy( void ){
-	_data = new zconf::byte[ ( 1 << 10 )  + 1 ];
+zippy::zippy( void ) : _failed( 0 ){
 }
 
 zippy::~zippy(){
-	delete _data;
 }
 
 void zippy::print_usage( void ){
@@ -133,7 +216,12 @@ void zippy::print_usage( void ){
 	std::cout              << "   -a extract all the zip entries"                    << std::endl;
 	std::cout              << "   -d compact zip entries / defrag"                   << std::endl;
 	std::cout              << "   -t list zip entries"                               << std::endl;
+	std::cout              << "   -j extract all the zip entries using n threads"    << std::endl;
+	std::cout              << "   -o extract all the zip entries to a directory"     << std::endl;
+	std::cout              << "   -m memory map the zip file ( read only )"          << std::endl;
+	std::cout              << "   -i import zip entry from cin"                      << std::endl;
 	std::cout              << "   -r remove zip entry"                               << std::endl;
+	std::cout              << "   -c copy the zip entries to another zip ( merge )"  << std::endl;
 	std::cout << std::endl << "examples:"                                            << std::endl;
 	std::cout              << "   1) Extract all zip entries to cout"                << std::endl;
 	std::cout              << "   $ zippy -a base.zip "                              << std::endl;
@@ -141,6 +229,63 @@ void zippy::print_usage( void ){
 	std::cout              << "   $ zippy -t base.zip "                              << std::endl;
 	std::cout << std::endl << "   3) Extract selected zip entry"                     << std::endl;
 	std::cout              << "   $ zippy base.zip moby-dick.txt > moby-dick.txt"    << std::endl;
+	std::cout << std::endl << "   4) Extract all zip entries to a directory with 8 threads" << std::endl;
+	std::cout              << "   $ zippy -a -j 8 -o base base.zip "                 << std::endl;
+	std::cout << std::endl << "   5) Import a zip entry, it's compressed with 4 threads" << std::endl;
+	std::cout              << "   $ zippy -i -j 4 base.zip moby-dick.txt < moby-dick.txt" << std::endl;
+	std::cout << std::endl << "   6) Compact a zip file"                             << std::endl;
+	std::cout              << "   $ zippy -d base.zip "                              << std::endl;
+	std::cout << std::endl << "   7) Remove a zip entry"                             << std::endl;
+	std::cout              << "   $ zippy -r base.zip moby-dick.txt "                << std::endl;
+	std::cout << std::endl << "   8) Merge the entries starting with books/ into all.zip" << std::endl;
+	std::cout              << "   $ zippy -c all.zip base.zip books/ "               << std::endl;
+}
+
+bool zippy::merge( const std::string &target_file, const std::string &prefix ){
+	ziparchive target( target_file.c_str(), ziparchive::fcreate );
+	if( !target.is_open() ){
+		std::cerr << "error: the target zip file couldn't be open" << std::endl;
+		return false;
+	}
+	// entries starting with prefix, compressed data is copied as it is
+	std::vector<std::string> entries = zip.entries();
+	bool failed = false;
+	for( size_t i=0;i<entries.size();i++ ){
+		if( entries[i].compare( 0, prefix.length(), prefix ) ) continue;
+		if( !target.copy( zip, entries[i] ).error().empty() ){
+			std::cerr << entries[i] << ": " << target.error() << std::endl;
+			failed = true;
+		}
+	}
+	// write the central directory
+	target.close();
+	return !failed;
+}
+
+bool zippy::import_stdin( const std::string &entrystr, zconf::uint32 threads ){
+	// append the entry at the end of the archive
+	zipentry *entry = zip.entry( entrystr.c_str(), 0, zstream::fwio );
+	if( entry == 0 ){
+		std::cerr << zip.error() << std::endl;
+		return false;
+	}
+	if( threads > 1 ) entry->setthreads( threads );
+	// copy the standard input
+	std::string buffer( ZCOBSIZE, 0 );
+	while( std::cin.good() && !( entry->flags() & zstream::ferr ) ){
+		std::cin.read( &buffer[0], buffer.size() );
+		entry->write( &buffer[0], std::cin.gcount() );
+	}
+	bool failed = ( entry->flags() & zstream::ferr ) != 0;
+	if( failed ) std::cerr << entry->error() << std::endl;
+	entry->close();
+	// write the central directory
+	zip.close();
+	if( !failed && !zip.error().empty() ){
+		std::cerr << zip.error() << std::endl;
+		return false;
+	}
+	return !failed;
 }
 
 void zippy::extract_entry( const std::string &entrystr ){
@@ -148,12 +293,9 @@ void zippy::extract_entry( const std::string &entrystr ){
 	zipentry *entry = zip.entry( entrystr.c_str() );
 	// check if it was found
 	if( entry ){
-		// read and output entry
-		while( !entry->eof() && !( entry->flags() & zstream::ferr ) ){
-			entry->read( _data, 1 << 10 );
-			_data[ entry->gcount() ] = '\0';
-			std::cout << _data;
-		}
+		// output entry straight to the standard output descriptor
+		std::cout.flush();
+		entry->copyto( 1 );
 		// output possible errors
 		if( entry->flags() & zstream::ferr ){
 			std::cerr << std::endl << std::endl << entry->error() << std::endl;
@@ -165,6 +307,150 @@ void zippy::extract_entry( const std::string &entrystr ){
 	}
 }
 
+static bool safe_path( const std::string &path ){
+	// absolute paths are not allowed
+	if( path.empty() || path[0] == '/' || path[0] == '\\' || ( path.length() > 1 && path[1] == ':' ) ){
+		return false;
+	}
+	// neither are parent references
+	std::string::size_type begin = 0;
+	while( begin <= path.length() ){
+		std::string::size_type end = path.find_first_of( "/\\", begin );
+		if( end == std::string::npos ){
+			end = path.length();
+		}
+		if( !path.compare( begin, end - begin, ".." ) ){
+			return false;
+		}
+		begin = end + 1;
+	}
+	return true;
+}
+
+static void make_dirs( const std::string &path ){
+	// create every parent directory of path, existing ones are ignored
+	for( std::string::size_type pos = path.find_first_of( "/\\", 1 ); pos != std::string::npos;
+		pos = path.find_first_of( "/\\", pos + 1 ) ){
+#ifdef _WIN32
+		_mkdir( path.substr( 0, pos ).c_str() );
+#else
+		mkdir( path.substr( 0, pos ).c_str(), 0755 );
+#endif
+	}
+}
+
+bool zippy::extract_directory( const std::string &directory, zconf::uint32 threads ){
+	std::vector<std::string> entries = zip.entries();
+	std::vector<std::pair<zconf::uint64,std::string> > sorted;
+	sorted.reserve( entries.size() );
+	for( zconf::uint64 i = 0; i < entries.size(); i++ ){
+		sorted.push_back( std::make_pair( zip.uncompressed_size( entries[i] ), entries[i] ) );
+	}
+	// largest entries first, so a big entry doesn't end alone at the tail
+	std::stable_sort( sorted.begin(), sorted.end(),
+		[]( const std::pair<zconf::uint64,std::string> &a, const std::pair<zconf::uint64,std::string> &b ){
+			return a.first > b.first;
+		} );
+	// deal the entries to the workers, every queue keeps the order
+	for( zconf::uint32 i = 0; i < threads; i++ ){
+		_queues.push_back( new work_queue() );
+	}
+	for( zconf::uint64 i = 0; i < sorted.size(); i++ ){
+		_queues[ i % threads ]->_entries.push_back( sorted[i].second );
+	}
+	_failed = 0;
+	// the current thread is the worker 0
+	std::vector<std::thread> workers;
+	for( zconf::uint32 i = 1; i < threads; i++ ){
+		workers.push_back( std::thread( &zippy::extract_worker, this, i, directory ) );
+	}
+	extract_worker( 0, directory );
+	for( zconf::uint32 i = 0; i < workers.size(); i++ ){
+		workers[i].join();
+	}
+	// release queues
+	for( zconf::uint32 i = 0; i < _queues.size(); i++ ){
+		delete _queues[i];
+	}
+	_queues.clear();
+	return _failed == 0;
+}
+
+void zippy::extract_worker( zconf::uint32 self, const std::string &directory ){
+	for( ;; ){
+		std::string entrystr;
+		bool found = false;
+		// own queue first, then steal the largest pending entry of the others
+		for( zconf::uint32 i = 0; i < _queues.size() && !found; i++ ){
+			work_queue &queue = *_queues[ ( self + i ) % _queues.size() ];
+			std::lock_guard<std::mutex> lock( queue._mutex );
+			if( !queue._entries.empty() ){
+				entrystr = queue._entries.front();
+				queue._entries.pop_front();
+				found = true;
+			}
+		}
+		// nothing left to do
+		if( !found ){
+			break;
+		}
+		bool done = extract_file( entrystr, directory );
+		// report
+		std::lock_guard<std::mutex> lock( _output );
+		if( done ){
+			std::cout << "[zippy::" << entrystr << "]" << std::endl;
+		}else{
+			_failed++;
+		}
+	}
+}
+
+bool zippy::extract_file( const std::string &entrystr, const std::string &directory ){
+	if( !safe_path( entrystr ) ){
+		std::lock_guard<std::mutex> lock( _output );
+		std::cerr << "error: entry '" << entrystr << "' has an unsafe path" << std::endl;
+		return false;
+	}
+	std::string path = directory + "/" + entrystr;
+	make_dirs( path );
+	// directories have no data
+	if( entrystr[ entrystr.length() - 1 ] == '/' ){
+		return true;
+	}
+	// open entry
+	zipentry *entry = zip.entry( entrystr );
+	if( !entry ){
+		std::lock_guard<std::mutex> lock( _output );
+		std::cerr << "error: entry '" << entrystr << "' not found" << std::endl;
+		return false;
+	}
+#ifdef _WIN32
+	int fd = _open( path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE );
+#else
+	int fd = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+#endif
+	// stored entries are copied kernel to kernel
+	if( fd >= 0 ) entry->copyto( fd );
+	bool done = fd >= 0 && !( entry->flags() & zstream::ferr );
+	// output possible errors
+	if( !done ){
+		std::lock_guard<std::mutex> lock( _output );
+		if( entry->flags() & zstream::ferr ){
+			std::cerr << "error: entry '" << entrystr << "': " << entry->error() << std::endl;
+		}else{
+			std::cerr << "error: can't write '" << path << "'" << std::endl;
+		}
+	}
+	// close entry and file
+	entry->close();
+#ifdef _WIN32
+	if( fd >= 0 ) _close( fd );
+#else
+	if( fd >= 0 ) close( fd );
+#endif
+	return done;
+}
+
 int main( int argc, char *argv[] ){
 	return zippy::get().main( argc, argv );
 }
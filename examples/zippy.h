@@ -20,6 +20,9 @@
 #include <ziparchive.h>
 
 #include <fstream>
+#include <deque>
+#include <mutex>
+#include <vector>
 
 class zippy{
 
@@ -34,6 +37,12 @@ public:
 	int main( int argc, char *argv[] );
 	// extract entry to stdout
 	void extract_entry( const std::string &entrystr );
+	// extract all the entries to a directory using n threads
+	bool extract_directory( const std::string &directory, zconf::uint32 threads );
+	// copy the entries starting with prefix to another archive
+	bool merge( const std::string &target_file, const std::string &prefix );
+	// import an entry from stdin
+	bool import_stdin( const std::string &entrystr, zconf::uint32 threads );
 
 public:
 	// destructor
@@ -43,12 +52,25 @@ private:
 	zippy( void );
     // print options
     void print_usage( void );
+	// extract entry to a file inside directory
+	bool extract_file( const std::string &entrystr, const std::string &directory );
+	// extraction worker, takes entries from its queue or steals them
+	void extract_worker( zconf::uint32 self, const std::string &directory );
 
 private:
     // archivo zip
 	ziparchive zip;
-	// create buffer
-	zconf::bytep _data;
+	// extraction queue of a worker, sorted largest entry first
+	typedef struct work_queue{
+		std::mutex _mutex;
+		std::deque<std::string> _entries;
+	} work_queue;
+	// one queue per worker
+	std::vector<work_queue*> _queues;
+	// serialize the output of the workers
+	std::mutex _output;
+	// number of failed extractions
+	zconf::uint32 _failed;
 
 };
 
@@ -0,0 +1,123 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "zahead.h"
+#include "zpool.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// state of a chunk buffer
+#define ZAPENDING 0
+#define ZAREADY   1
+#define ZAFAILED  2
+
+typedef struct zahead::core{
+	// source of the compressed data
+	const zsource *_src;
+	// the i/o thread
+	zpool *_pool;
+	// chunk buffers ( depth + 1 ), the chunk each one holds, where it's read from & its state
+	std::vector<zconf::bytep> _buffers;
+	std::vector<zconf::uint64> _chunks, _offsets, _sizes;
+	std::vector<zconf::uint32> _states;
+	// chunks ahead, chunk size, start & end of the range
+	zconf::uint32 _depth;
+	zconf::uint64 _csize, _start, _end;
+	// next chunk to take & if the chunks were started
+	zconf::uint64 _next;
+	bool _running;
+	// guards the states
+	std::mutex _mutex;
+	std::condition_variable _ready;
+};
+
+zahead::zahead( const zsource &src, zconf::uint32 depth, zconf::uint64 csize, zconf::uint64 end ){
+	_core = new core;
+	// at least double buffering
+	if( depth == 0 ) depth = 1;
+	_core->_src = &src; _core->_depth = depth; _core->_csize = csize;
+	_core->_start = 0; _core->_end = end; _core->_next = 0; _core->_running = false;
+	_core->_pool = new zpool( 1 );
+	for( zconf::uint32 i = 0; i <= depth; i++ ){
+		_core->_buffers.push_back( new zconf::byte[ csize ] );
+	}
+	_core->_chunks.resize( depth + 1, 0 );
+	_core->_offsets.resize( depth + 1, 0 ); _core->_sizes.resize( depth + 1, 0 );
+	_core->_states.resize( depth + 1, ZAFAILED );
+}
+
+zahead::~zahead( void ){
+	// the reads use the buffers
+	delete _core->_pool;
+	for( zconf::uint32 i = 0; i < _core->_buffers.size(); i++ ){
+		delete[] _core->_buffers[i];
+	}
+	delete _core;
+}
+
+void zahead::queue( zconf::uint64 n ){
+	zconf::uint64 offset = _core->_start + n * _core->_csize;
+	if( offset >= _core->_end ) return;
+	zconf::uint64 size = _core->_end - offset;
+	if( size > _core->_csize ) size = _core->_csize;
+	zconf::uint32 slot = n % _core->_buffers.size();
+	{
+		std::lock_guard<std::mutex> lock( _core->_mutex );
+		_core->_chunks[ slot ] = n; _core->_states[ slot ] = ZAPENDING;
+		_core->_offsets[ slot ] = offset; _core->_sizes[ slot ] = size;
+	}
+	// small captures don't allocate the job
+	core *acore = _core;
+	_core->_pool->push( [acore, slot](){
+		zconf::uint64 size = acore->_sizes[ slot ];
+		zconf::uint64 got = acore->_src->pread( acore->_buffers[ slot ], size, acore->_offsets[ slot ] );
+		std::lock_guard<std::mutex> lock( acore->_mutex );
+		acore->_states[ slot ] = got == size ? ZAREADY : ZAFAILED;
+		acore->_ready.notify_all();
+	} );
+}
+
+void zahead::restart( zconf::uint64 offset ){
+	// the chunks on the way are dropped
+	_core->_pool->wait();
+	_core->_start = offset; _core->_next = 0; _core->_running = true;
+	for( zconf::uint64 n = 0; n <= _core->_depth; n++ ) queue( n );
+}
+
+const zconf::byte *zahead::take( zconf::uint64 offset, zconf::uint64 size ){
+	if( offset >= _core->_end || size > _core->_csize ) return 0;
+	zconf::uint64 expected = _core->_end - offset;
+	if( expected > _core->_csize ) expected = _core->_csize;
+	// a partial chunk is read on its own ( the next take starts over )
+	if( size != expected ){
+		_core->_pool->wait(); _core->_running = false;
+		return _core->_src->pread( _core->_buffers[0], size, offset ) == size ? _core->_buffers[0] : 0;
+	}
+	// chunks are taken in order, anything else is a seek
+	if( !_core->_running || offset != _core->_start + _core->_next * _core->_csize ) restart( offset );
+	// the buffer of the previous chunk isn't used anymore, it reads the one after the last
+	if( _core->_next > 0 ) queue( _core->_next - 1 + _core->_buffers.size() );
+	// wait for the chunk
+	zconf::uint32 slot = _core->_next % _core->_buffers.size();
+	std::unique_lock<std::mutex> lock( _core->_mutex );
+	while( _core->_states[ slot ] == ZAPENDING ) _core->_ready.wait( lock );
+	bool ready = _core->_states[ slot ] == ZAREADY && _core->_chunks[ slot ] == _core->_next;
+	_core->_next++;
+	return ready ? _core->_buffers[ slot ] : 0;
+}
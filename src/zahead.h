@@ -0,0 +1,58 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ZAHEAD_H_
+#define ZAHEAD_H_
+
+#include "zconf.h"
+#include "zsource.h"
+
+/**
+ * zahead reads the compressed data of a stream ahead on another thread:
+ * the range is split in chunks, while one chunk is inflated the next
+ * depth ones are read into their own buffers, so i/o & inflate overlap
+ * <br /><br />
+ * chunks are taken in order; taking any other offset ( a seek ) drops
+ * the chunks read so far and starts over from there
+ */
+class zahead{
+
+public:
+	// constructor ( source, chunks read ahead, chunk size & end of the range )
+	zahead( const zsource &src, zconf::uint32 depth, zconf::uint64 csize, zconf::uint64 end );
+	// destructor, waits for the pending reads
+	virtual ~zahead( void );
+
+public:
+	// get the chunk of size bytes at offset, the previous one can be reused ( 0 on errors )
+	const zconf::byte *take( zconf::uint64 offset, zconf::uint64 size );
+
+private:
+	// queue the read of the chunk n ( relative to the start )
+	void queue( zconf::uint64 n );
+	// drop every chunk & start over from offset
+	void restart( zconf::uint64 offset );
+
+private:
+	// class core structure declaration
+	typedef struct core;
+	// internal core structure
+	core *_core;
+
+};
+
+#endif //ZAHEAD_H_
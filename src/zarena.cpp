@@ -0,0 +1,120 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "zarena.h"
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+// blocks are aligned & keep their size right before them
+#define ZAALIGN 16
+
+typedef struct zarena::core{
+	// chunks taken from the heap & chunk size
+	std::vector<zconf::bytep> _chunks;
+	zconf::uint64 _csize;
+	// free space of the last chunk
+	zconf::bytep _next;
+	zconf::uint64 _left;
+	// released blocks by size
+	std::map<zconf::uint64, std::vector<zconf::bytep> > _free;
+	// bytes taken & bytes used
+	zconf::uint64 _size, _used;
+	// reset zlib states & their kinds, they live in the chunks
+	std::vector<std::pair<zconf::int32, voidpf> > _states;
+	// the arena can be shared
+	std::mutex _mutex;
+};
+
+zarena::zarena( zconf::uint64 csize ){
+	_core = new core;
+	// set values to zero
+	_core->_csize = csize; _core->_next = 0; _core->_left = 0;
+	_core->_size = _core->_used = 0;
+}
+
+zarena::~zarena( void ){
+	for( zconf::uint64 idx = 0; idx < _core->_chunks.size(); idx++ ) delete[] _core->_chunks[ idx ];
+	delete _core;
+}
+
+voidpf zarena::zalloc( voidpf opaque, uInt items, uInt size ){
+	core *arena = static_cast<zarena*>( opaque )->_core;
+	zconf::uint64 bytes = ( ( static_cast<zconf::uint64>( items ) * size + ZAALIGN - 1 ) / ZAALIGN + 1 ) * ZAALIGN;
+	std::lock_guard<std::mutex> lock( arena->_mutex );
+	zconf::bytep block = 0;
+	// a released block of the same size
+	std::map<zconf::uint64, std::vector<zconf::bytep> >::iterator found = arena->_free.find( bytes );
+	if( found != arena->_free.end() && !found->second.empty() ){
+		block = found->second.back(); found->second.pop_back();
+	}else{
+		// the rest of the last chunk is lost if the block doesn't fit
+		if( bytes > arena->_left ){
+			zconf::uint64 csize = bytes > arena->_csize ? bytes : arena->_csize;
+			arena->_next = new zconf::byte[ csize + ZAALIGN ];
+			arena->_chunks.push_back( arena->_next );
+			// new[] only guarantees the alignment of the fundamental types
+			zconf::uint64 skew = reinterpret_cast<zconf::uint64>( arena->_next ) % ZAALIGN;
+			if( skew != 0 ) arena->_next += ZAALIGN - skew;
+			arena->_left = csize; arena->_size += csize + ZAALIGN;
+		}
+		block = arena->_next;
+		arena->_next += bytes; arena->_left -= bytes;
+		*reinterpret_cast<zconf::uint64*>( block ) = bytes;
+	}
+	arena->_used += bytes;
+	return block + ZAALIGN;
+}
+
+void zarena::zfree( voidpf opaque, voidpf address ){
+	if( address == 0 ) return;
+	core *arena = static_cast<zarena*>( opaque )->_core;
+	zconf::bytep block = static_cast<zconf::bytep>( address ) - ZAALIGN;
+	zconf::uint64 bytes = *reinterpret_cast<zconf::uint64*>( block );
+	std::lock_guard<std::mutex> lock( arena->_mutex );
+	arena->_free[ bytes ].push_back( block );
+	arena->_used -= bytes;
+}
+
+zconf::uint64 zarena::size( void ) const{
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	return _core->_size;
+}
+
+zconf::uint64 zarena::used( void ) const{
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	return _core->_used;
+}
+
+bool zarena::keep( zconf::int32 kind, voidpf state ){
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	if( _core->_states.size() >= ZCCACHE ) return false;
+	_core->_states.push_back( std::make_pair( kind, state ) );
+	return true;
+}
+
+voidpf zarena::reuse( zconf::int32 kind ){
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	for( zconf::uint64 idx = _core->_states.size(); idx-- > 0; ){
+		if( _core->_states[ idx ].first != kind ) continue;
+		voidpf state = _core->_states[ idx ].second;
+		_core->_states.erase( _core->_states.begin() + idx );
+		return state;
+	}
+	return 0;
+}
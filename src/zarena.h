@@ -0,0 +1,64 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ZARENA_H_
+#define ZARENA_H_
+
+#include "zconf.h"
+
+/**
+ * zarena serves the allocations of zlib: memory is carved from big
+ * chunks, sized for a deflate state, and the freed blocks are kept by
+ * size for the next states, so nothing goes back to the heap until the
+ * arena is destroyed and the states of busy streams don't fragment it
+ * <br /><br />
+ * give it to a stream or an archive through setalloc, the arena is the
+ * opaque pointer; many threads can share one, each thread can also
+ * have its own to avoid the lock; the zlib states of the closed
+ * streams are reset & kept by the arena for its next streams
+ */
+class zarena{
+
+public:
+	// constructor ( chunk size )
+	zarena( zconf::uint64 csize = ZCARENA );
+	// destructor, the streams using it must be closed
+	virtual ~zarena( void );
+
+public:
+	// zlib allocation hook ( opaque is the arena )
+	static voidpf zalloc( voidpf opaque, uInt items, uInt size );
+	// zlib release hook ( opaque is the arena )
+	static void zfree( voidpf opaque, voidpf address );
+	// bytes taken from the heap
+	zconf::uint64 size( void ) const;
+	// bytes given to zlib right now
+	zconf::uint64 used( void ) const;
+	// keep a reset zlib state of the given kind for the next stream ( false if the arena has enough )
+	bool keep( zconf::int32 kind, voidpf state );
+	// take a kept zlib state of the given kind ( 0 if there's none )
+	voidpf reuse( zconf::int32 kind );
+
+private:
+	// class core structure declaration
+	typedef struct core;
+	// internal core structure
+	core *_core;
+
+};
+
+#endif //ZARENA_H_
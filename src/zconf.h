@@ -24,6 +24,35 @@
 #define ZCOBSIZE ( ( 1 << 20 )      ) // 1.0 MB
 #define ZCIBSIZE ( ( 1 << 10 ) << 7 ) // 128 KB
 
+// reads from this size on are inflated straight into the caller's buffer
+#define ZCDIRECT    ( ( 1 << 10 ) << 4 ) // 16 KB
+#define ZCDIRECTMAX ( ( 1 << 30 )      ) // 1.0 GB per inflate call
+
+// small entries are read with one i/o & inflated with one call when the request covers them
+#define ZCSMALL  ( ( 1 << 10 ) << 6 ) // 64 KB
+
+// block size of the parallel deflate
+#define ZCPBSIZE ( ( 1 << 10 ) << 7 ) // 128 KB
+
+// distance between the access points of a seek index
+#define ZCSPAN   ( ( 1 << 20 )      ) // 1.0 MB
+
+// smallest stream buffer, streams use smaller ones when their entry is smaller
+#define ZCMINBS  ( ( 1 << 10 ) << 2 ) // 4.0 KB
+
+// idle buffers & zlib states each thread keeps for its next streams
+#define ZCCACHE  8
+
+// arena chunk, a deflate state of the default memory level: window, prev, head & pending
+// buffer ( 64 KB each, pending up to 80 KB ) plus the state itself, or ~8 inflate states
+#define ZCARENA  ( ( 1 << 10 ) * 320 ) // 320 KB
+
+// compressed chunks read ahead of the one being inflated ( 1 is double buffering )
+#define ZCAHEAD  1
+
+// buffer of the moves inside a file ( defrag )
+#define ZCMOVE   ( ( 1 << 20 ) << 3 ) // 8.0 MB
+
 namespace zconf {
 
 // pointers and data
@@ -32,12 +61,14 @@ typedef byte*              bytep;
 typedef const bytep        cbytep;
 
 // integer types
-typedef   signed short int  int16;
-typedef unsigned short int uint16;
-typedef   signed       int  int32;
-typedef unsigned       int uint32;
-typedef   signed long  int  int64;
-typedef unsigned long  int uint64;
+typedef   signed           char  int8;
+typedef unsigned           char uint8;
+typedef   signed short      int  int16;
+typedef unsigned short      int uint16;
+typedef   signed            int  int32;
+typedef unsigned            int uint32;
+typedef   signed long long  int  int64;
+typedef unsigned long long  int uint64;
 
 }; // namespace zconf
 
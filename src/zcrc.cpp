@@ -0,0 +1,162 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "zcrc.h"
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+	#define ZCRC_CLMUL
+	#include <immintrin.h>
+#elif defined( __aarch64__ ) && defined( __ARM_FEATURE_CRC32 )
+	#define ZCRC_ARMV8
+	#include <arm_acle.h>
+	#include <cstring>
+#endif
+
+// zlib takes at most an uInt on every call
+#define ZCRCCHUNK ( 1 << 30 )
+
+#ifdef ZCRC_CLMUL
+
+// folding needs 64 bytes at least
+#define ZCRCMIN 64
+
+// fold 16 bytes blocks by carry-less multiplication, see Intel's "Fast CRC
+// Computation for Generic Polynomials Using PCLMULQDQ Instruction", the crc
+// is not inverted here and nbytes must be a multiple of 16
+__attribute__(( target( "pclmul,sse4.1" ) ))
+static zconf::uint32 crc_clmul( zconf::uint32 crc, const zconf::byte *data, zconf::uint64 nbytes ){
+	// bit reflected constants of the paper
+	static const zconf::uint64 k1k2[] __attribute__(( aligned( 16 ) )) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const zconf::uint64 k3k4[] __attribute__(( aligned( 16 ) )) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const zconf::uint64 k5k0[] __attribute__(( aligned( 16 ) )) = { 0x0163cd6124ULL, 0x0000000000ULL };
+	static const zconf::uint64 poly[] __attribute__(( aligned( 16 ) )) = { 0x01db710641ULL, 0x01f7011641ULL };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	// first 64 bytes
+	x1 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 0x00 ) );
+	x2 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 0x10 ) );
+	x3 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 0x20 ) );
+	x4 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 0x30 ) );
+	x1 = _mm_xor_si128( x1, _mm_cvtsi32_si128( crc ) );
+	x0 = _mm_load_si128( reinterpret_cast<const __m128i*>( k1k2 ) );
+	data += 64; nbytes -= 64;
+
+	// fold 64 bytes blocks in parallel
+	while( nbytes >= 64 ){
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+		x6 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+		x7 = _mm_clmulepi64_si128( x3, x0, 0x00 );
+		x8 = _mm_clmulepi64_si128( x4, x0, 0x00 );
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+		x2 = _mm_clmulepi64_si128( x2, x0, 0x11 );
+		x3 = _mm_clmulepi64_si128( x3, x0, 0x11 );
+		x4 = _mm_clmulepi64_si128( x4, x0, 0x11 );
+		y5 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 0x00 ) );
+		y6 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 0x10 ) );
+		y7 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 0x20 ) );
+		y8 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 0x30 ) );
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, x5 ), y5 );
+		x2 = _mm_xor_si128( _mm_xor_si128( x2, x6 ), y6 );
+		x3 = _mm_xor_si128( _mm_xor_si128( x3, x7 ), y7 );
+		x4 = _mm_xor_si128( _mm_xor_si128( x4, x8 ), y8 );
+		data += 64; nbytes -= 64;
+	}
+
+	// fold into 128 bits
+	x0 = _mm_load_si128( reinterpret_cast<const __m128i*>( k3k4 ) );
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x2 ), x5 );
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x3 ), x5 );
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x4 ), x5 );
+
+	// fold the remaining 16 bytes blocks
+	while( nbytes >= 16 ){
+		x2 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data ) );
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, x2 ), x5 );
+		data += 16; nbytes -= 16;
+	}
+
+	// fold 128 bits into 64 bits
+	x2 = _mm_clmulepi64_si128( x1, x0, 0x10 );
+	x3 = _mm_setr_epi32( ~0, 0, ~0, 0 );
+	x1 = _mm_srli_si128( x1, 8 );
+	x1 = _mm_xor_si128( x1, x2 );
+	x0 = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( k5k0 ) );
+	x2 = _mm_srli_si128( x1, 4 );
+	x1 = _mm_and_si128( x1, x3 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_xor_si128( x1, x2 );
+
+	// barrett reduction to 32 bits
+	x0 = _mm_load_si128( reinterpret_cast<const __m128i*>( poly ) );
+	x2 = _mm_and_si128( x1, x3 );
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x10 );
+	x2 = _mm_and_si128( x2, x3 );
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+	x1 = _mm_xor_si128( x1, x2 );
+	return _mm_extract_epi32( x1, 1 );
+}
+
+// the processor is checked once
+static bool has_clmul( void ){
+	static const bool clmul = __builtin_cpu_supports( "pclmul" ) && __builtin_cpu_supports( "sse4.1" );
+	return clmul;
+}
+
+#endif // ZCRC_CLMUL
+
+#ifdef ZCRC_ARMV8
+
+// crc instructions of ARMv8, the crc is not inverted here
+static zconf::uint32 crc_armv8( zconf::uint32 crc, const zconf::byte *data, zconf::uint64 nbytes ){
+	while( nbytes >= 8 ){
+		zconf::uint64 value; std::memcpy( &value, data, 8 );
+		crc = __crc32d( crc, value ); data += 8; nbytes -= 8;
+	}
+	while( nbytes > 0 ){
+		crc = __crc32b( crc, *data++ ); nbytes--;
+	}
+	return crc;
+}
+
+#endif // ZCRC_ARMV8
+
+zconf::uint32 zcrc::update( zconf::uint32 crc, const zconf::byte *data, zconf::uint64 nbytes ){
+#if defined( ZCRC_CLMUL )
+	if( nbytes >= ZCRCMIN && has_clmul() ){
+		zconf::uint64 size = nbytes & ~static_cast<zconf::uint64>( 15 );
+		crc = ~crc_clmul( ~crc, data, size );
+		data += size; nbytes -= size;
+	}
+#elif defined( ZCRC_ARMV8 )
+	return ~crc_armv8( ~crc, data, nbytes );
+#endif
+	// portable fallback
+	while( nbytes > 0 ){
+		zconf::uint32 size = nbytes > ZCRCCHUNK ? ZCRCCHUNK : static_cast<zconf::uint32>( nbytes );
+		crc = crc32( crc, reinterpret_cast<const Bytef*>( data ), size );
+		data += size; nbytes -= size;
+	}
+	return crc;
+}
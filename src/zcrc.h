@@ -0,0 +1,36 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ZCRC_H_
+#define ZCRC_H_
+
+#include "zconf.h"
+
+/**
+ * zcrc computes the crc-32 of zip entries, with carry-less multiplication
+ * ( PCLMULQDQ ) on x86 processors that have it, the ARMv8 crc instructions
+ * when they're enabled at compile time and zlib's crc32 otherwise
+ */
+class zcrc{
+
+public:
+	// update crc with n bytes of data
+	static zconf::uint32 update( zconf::uint32 crc, const zconf::byte *data, zconf::uint64 nbytes );
+
+};
+
+#endif //ZCRC_H_
@@ -0,0 +1,227 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "zindex.h"
+
+#include <cstdio>
+#include <vector>
+
+// sidecar file signature & version
+#define ZIDXSIGN 0x5844495a // "ZIDX"
+#define ZIDXVERSION 1
+// header: signature, version, span, csize, usize, number of points & crc
+#define ZIDXHSIZE 40
+// point: uoffset, coffset, bits, window size & compressed window size
+#define ZIDXPSIZE 25
+// largest window of a point ( the deflate window )
+#define ZIDXWSIZE ( 1 << 15 )
+
+// little endian values
+static void put_le( std::string &out, zconf::uint64 value, zconf::uint32 size ){
+	for( zconf::uint32 i = 0; i < size; i++ ) out.push_back( static_cast<zconf::byte>( value >> ( 8 * i ) ) );
+}
+
+static zconf::uint64 get_le( const zconf::byte *in, zconf::uint32 size ){
+	zconf::uint64 value = 0;
+	for( zconf::uint32 i = 0; i < size; i++ ) value |= static_cast<zconf::uint64>( static_cast<zconf::uint8>( in[i] ) ) << ( 8 * i );
+	return value;
+}
+
+// access point
+typedef struct zpoint{
+	zconf::uint64 _uoffset, _coffset;
+	zconf::uint8 _bits;
+	std::string _window;
+} zpoint;
+
+typedef struct zindex::core{
+	// access points sorted by uncompressed offset
+	std::vector<zpoint> _points;
+	// distance between access points
+	zconf::uint64 _span;
+	// error string
+	std::string _error;
+};
+
+zindex::zindex( zconf::uint64 span ){
+	_core = new core;
+	// set values
+	_core->_span = span;
+}
+
+zindex::~zindex( void ){
+	delete _core;
+}
+
+zindex &zindex::add( zconf::uint64 uoffset, zconf::uint64 coffset, zconf::uint8 bits,
+	const zconf::byte *window, zconf::uint64 wsize ){
+	// points are only added forwards
+	if( !_core->_points.empty() && _core->_points.back()._uoffset >= uoffset ) return *this;
+	_core->_points.push_back( zpoint() );
+	zpoint &point = _core->_points.back();
+	point._uoffset = uoffset; point._coffset = coffset; point._bits = bits;
+	point._window.assign( window, wsize );
+	// return reference
+	return *this;
+}
+
+zconf::int64 zindex::find( zconf::uint64 uoffset ) const{
+	// binary search of the last point at or before uoffset
+	zconf::uint64 low = 0, high = _core->_points.size();
+	while( low < high ){
+		zconf::uint64 mid = ( low + high ) / 2;
+		if( _core->_points[ mid ]._uoffset <= uoffset ){
+			low = mid + 1;
+		}else{
+			high = mid;
+		}
+	}
+	return static_cast<zconf::int64>( low ) - 1;
+}
+
+zindex &zindex::clear( void ){
+	_core->_points.clear();
+	// return reference
+	return *this;
+}
+
+zconf::uint64 zindex::size( void ) const{
+	return _core->_points.size();
+}
+
+zconf::uint64 zindex::uoffset( zconf::uint64 n ) const{
+	return _core->_points[n]._uoffset;
+}
+
+zconf::uint64 zindex::coffset( zconf::uint64 n ) const{
+	return _core->_points[n]._coffset;
+}
+
+zconf::uint8 zindex::bits( zconf::uint64 n ) const{
+	return _core->_points[n]._bits;
+}
+
+const std::string &zindex::window( zconf::uint64 n ) const{
+	return _core->_points[n]._window;
+}
+
+bool zindex::save( const char *path, zconf::uint64 csize, zconf::uint64 usize, zconf::uint32 crc ) const{
+	std::string out;
+	// header
+	put_le( out, ZIDXSIGN, 4 ); put_le( out, ZIDXVERSION, 4 ); put_le( out, _core->_span, 8 );
+	put_le( out, csize, 8 ); put_le( out, usize, 8 ); put_le( out, _core->_points.size(), 4 );
+	put_le( out, crc, 4 );
+	// points, windows are compressed
+	std::string window;
+	for( zconf::uint64 n = 0; n < _core->_points.size(); n++ ){
+		const zpoint &point = _core->_points[n];
+		uLongf wsize = compressBound( point._window.size() );
+		window.resize( wsize );
+		if( compress2( reinterpret_cast<Bytef*>( &window[0] ), &wsize,
+			reinterpret_cast<const Bytef*>( point._window.data() ), point._window.size(), Z_BEST_SPEED ) != Z_OK ){
+			_core->_error = "zindex: wasn't able to compress a window";
+			return false;
+		}
+		put_le( out, point._uoffset, 8 ); put_le( out, point._coffset, 8 ); put_le( out, point._bits, 1 );
+		put_le( out, point._window.size(), 4 ); put_le( out, wsize, 4 );
+		out.append( window.data(), wsize );
+	}
+	// write the file at once
+	FILE *file = std::fopen( path, "wb" );
+	if( file == 0 ){
+		_core->_error = "zindex: wasn't able to create the file";
+		return false;
+	}
+	bool done = std::fwrite( out.data(), 1, out.size(), file ) == out.size();
+	done = ( std::fclose( file ) == 0 ) && done;
+	if( !done ) _core->_error = "zindex: wasn't able to write the file";
+	return done;
+}
+
+bool zindex::load( const char *path, zconf::uint64 csize, zconf::uint64 usize, zconf::uint32 crc ){
+	std::string in;
+	// read the file at once
+	FILE *file = std::fopen( path, "rb" );
+	if( file == 0 ){
+		_core->_error = "zindex: wasn't able to open the file";
+		return false;
+	}
+	zconf::byte buffer[ 1 << 16 ]; size_t count;
+	while( ( count = std::fread( buffer, 1, sizeof( buffer ), file ) ) > 0 ) in.append( buffer, count );
+	std::fclose( file );
+	// check the header
+	const zconf::byte *cursor = in.data(), *end = in.data() + in.size();
+	if( in.size() < ZIDXHSIZE || get_le( cursor, 4 ) != ZIDXSIGN || get_le( cursor + 4, 4 ) != ZIDXVERSION ){
+		_core->_error = "zindex: the file is not an index";
+		return false;
+	}
+	if( get_le( cursor + 16, 8 ) != csize || get_le( cursor + 24, 8 ) != usize || get_le( cursor + 36, 4 ) != crc ){
+		_core->_error = "zindex: the index belongs to another stream";
+		return false;
+	}
+	zconf::uint64 span = get_le( cursor + 8, 8 ), npoints = get_le( cursor + 32, 4 );
+	cursor += ZIDXHSIZE;
+	// every point takes its record at least ( nothing is allocated for a wrong count )
+	if( npoints > ( in.size() - ZIDXHSIZE ) / ZIDXPSIZE ){
+		_core->_error = "zindex: the index is corrupted";
+		return false;
+	}
+	// read the points
+	std::vector<zpoint> points( npoints );
+	for( zconf::uint64 n = 0; n < npoints; n++ ){
+		zpoint &point = points[n];
+		if( end - cursor < ZIDXPSIZE ) break;
+		point._uoffset = get_le( cursor, 8 ); point._coffset = get_le( cursor + 8, 8 );
+		point._bits = get_le( cursor + 16, 1 );
+		uLongf wsize = get_le( cursor + 17, 4 ); zconf::uint64 clen = get_le( cursor + 21, 4 );
+		cursor += ZIDXPSIZE;
+		if( static_cast<zconf::uint64>( end - cursor ) < clen || point._bits > 7 || wsize > ZIDXWSIZE ||
+			( n > 0 && point._uoffset <= points[ n - 1 ]._uoffset ) ) break;
+		// points inside the stream ( the first bits are in the previous byte )
+		if( point._coffset > csize || point._uoffset > usize || ( point._bits && point._coffset == 0 ) ) break;
+		point._window.resize( wsize );
+		if( wsize > 0 && uncompress( reinterpret_cast<Bytef*>( &point._window[0] ), &wsize,
+			reinterpret_cast<const Bytef*>( cursor ), clen ) != Z_OK ) break;
+		if( wsize != point._window.size() ) break;
+		cursor += clen;
+		// every point was read
+		if( n + 1 == npoints ){
+			_core->_points.swap( points ); _core->_span = span;
+			return true;
+		}
+	}
+	if( npoints == 0 ){
+		_core->_points.clear(); _core->_span = span;
+		return true;
+	}
+	_core->_error = "zindex: the index is corrupted";
+	return false;
+}
+
+const std::string &zindex::error( void ) const{
+	return _core->_error;
+}
+
+zindex &zindex::setspan( zconf::uint64 span ){
+	_core->_span = span;
+	// return reference
+	return *this;
+}
+
+zconf::uint64 zindex::span( void ) const{
+	return _core->_span;
+}
@@ -0,0 +1,86 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ZINDEX_H_
+#define ZINDEX_H_
+
+#include "zconf.h"
+
+#include <string>
+
+/**
+ * zindex keeps access points of a deflate stream, each one is the
+ * position of a block boundary ( compressed offset plus bits ) and the
+ * 32 KB of uncompressed data before it, so inflate can be resumed from
+ * there without going through the whole stream, as in zlib's zran
+ * <br /><br />
+ * an index can be saved to a sidecar file and loaded by a later process,
+ * the file records the sizes and crc-32 of its stream, so an index of
+ * another stream ( or an older version of it ) is rejected
+ */
+class zindex{
+
+public:
+	// default constructor
+	zindex( zconf::uint64 span = 0 );
+	// destructor
+	virtual ~zindex( void );
+
+public:
+	// add an access point after the last one
+	zindex &add( zconf::uint64 uoffset, zconf::uint64 coffset, zconf::uint8 bits,
+		const zconf::byte *window, zconf::uint64 wsize );
+	// nearest access point at or before uoffset, -1 if there's none
+	zconf::int64 find( zconf::uint64 uoffset ) const;
+	// remove every access point
+	zindex &clear( void );
+	// number of access points
+	zconf::uint64 size( void ) const;
+
+public:
+	// uncompressed offset of the access point
+	zconf::uint64 uoffset( zconf::uint64 n ) const;
+	// compressed offset of the access point ( the byte after the bits )
+	zconf::uint64 coffset( zconf::uint64 n ) const;
+	// bits of the previous byte that belong to the access point
+	zconf::uint8 bits( zconf::uint64 n ) const;
+	// uncompressed data before the access point
+	const std::string &window( zconf::uint64 n ) const;
+
+public:
+	// save the access points of a stream to a file
+	bool save( const char *path, zconf::uint64 csize, zconf::uint64 usize, zconf::uint32 crc ) const;
+	// load the access points of a stream from a file
+	bool load( const char *path, zconf::uint64 csize, zconf::uint64 usize, zconf::uint32 crc );
+	// get error string
+	const std::string &error( void ) const;
+
+public:
+	// set the distance between access points ( 0 disables indexing )
+	zindex &setspan( zconf::uint64 span );
+	// get the distance between access points
+	zconf::uint64 span( void ) const;
+
+private:
+	// class core structure declaration
+	typedef struct core;
+	// internal core structure
+	core *_core;
+
+};
+
+#endif //ZINDEX_H_
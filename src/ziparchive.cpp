@@ -17,14 +17,29 @@
 #include "ziparchive.h"
 
 #include <sstream>
-#include <fstream>
 #include <cstring>
 #include <iomanip>
+#include <algorithm>
 #include <list>
-#include <set>
+#include <map>
+#include <mutex>
+#include <ctime>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define ZSCAN_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 // end of central directory signature
 #define ECDSIGN   0x06054b50
+// zip64 end of central directory signature
+#define ECD64SIGN 0x06064b50
+// zip64 end of central directory locator signature
+#define ECDL64SIGN 0x07064b50
 // end of central directory file header signature
 #define ECDFHSIGN 0x02014b50
 // end of local file header signature
@@ -33,215 +48,1118 @@
 #define LFHSIGN   0x04034b50
 // local file header size without extra fields
 #define LFHSIZE   30
+// central directory file header size without extra fields
+#define CDFHSIZE  46
+// end of central directory record size without comment
+#define ECDSIZE   22
+// maximum distance from the end of central directory record to the end of file
+#define ECDMAXTAIL ( ECDSIZE + 0xFFFF )
+// zip64 end of central directory record size without extensible data
+#define ECD64SIZE 56
+// zip64 end of central directory locator size
+#define ECDL64SIZE 20
+// zip64 extended information extra field tag
+#define ZIP64TAG  0x0001
+// saturated zip32 fields announce zip64 values
+#define ZIP64U16  0xFFFF
+#define ZIP64U32  0xFFFFFFFF
+#define ZIP64MAX  0xFFFFFFFFFFFFFFFFULL
+// signature scanning chunk size
+#define ZSCANSIZE ( 1 << 16 )
+// data descriptor size ( zip64 sizes )
+#define DDSIZE    16
+#define DD64SIZE  24
+// versions needed to extract
+#define VERSION20 20
+#define VERSION45 45
+// general purpose flag: sizes & crc-32 in the data descriptor
+#define FLAGDD    0x0008
+
+// little-endian field decoding
+static inline zconf::uint16 le16( const zconf::byte *p ){
+	const unsigned char *u = reinterpret_cast<const unsigned char *>( p );
+	return u[0] | ( u[1] << 8 );
+}
+
+static inline zconf::uint32 le32( const zconf::byte *p ){
+	const unsigned char *u = reinterpret_cast<const unsigned char *>( p );
+	return u[0] | ( u[1] << 8 ) | ( u[2] << 16 ) | ( (zconf::uint32) u[3] << 24 );
+}
+
+static inline zconf::uint64 le64( const zconf::byte *p ){
+	return le32( p ) | ( (zconf::uint64) le32( p + 4 ) << 32 );
+}
+
+// little endian writes
+static inline void put16( std::string &out, zconf::uint16 value ){
+	out.push_back( static_cast<zconf::byte>( value ) ); out.push_back( static_cast<zconf::byte>( value >> 8 ) );
+}
+
+static inline void put32( std::string &out, zconf::uint32 value ){
+	put16( out, value ); put16( out, value >> 16 );
+}
+
+static inline void put64( std::string &out, zconf::uint64 value ){
+	put32( out, value ); put32( out, value >> 32 );
+}
+
+// bit scanning over a non-zero mask
+static inline zconf::uint32 lowbit( zconf::uint32 mask ){
+#ifdef _MSC_VER
+	unsigned long idx; _BitScanForward( &idx, mask ); return idx;
+#else
+	return __builtin_ctz( mask );
+#endif
+}
+
+static inline zconf::uint32 highbit( zconf::uint32 mask ){
+#ifdef _MSC_VER
+	unsigned long idx; _BitScanReverse( &idx, mask ); return idx;
+#else
+	return 31 - __builtin_clz( mask );
+#endif
+}
 
-typedef struct file_info_32{
-    zconf::uint16 _version;              // version made by                 2 bytes
-    zconf::uint16 _version_needed;       // version needed to extract       2 bytes
-    zconf::uint16 _flag;                 // general purpose bit flag        2 bytes
-    zconf::uint16 _compression_method;   // compression method              2 bytes
-    // dos_date;                         // last mod file date in DOS fmt   4 bytes
-    zconf::uint32 _crc;                  // crc-32                          4 bytes
-    zconf::uint32 _compressed_size;      // compressed size                 4 bytes
-    zconf::uint32 _uncompressed_size;    // uncompressed size               4 bytes
-    // size_file_name;                   // filename length                 2 bytes
-    // size_file_extra;                  // extra field length              2 bytes
-    // size_file_comment;                // file comment length             2 bytes
-    zconf::uint16 _disk_num_start;       // disk number start               2 bytes
-    zconf::uint16 _internal_fa;          // internal file attributes        2 bytes
-    zconf::uint32 _external_fa;          // external file attributes        4 bytes
-    zconf::uint32 _relative_offset;      // relative offset to the local    4 bytes
+// central directory register states
+#define CDRLOCATED 0x01 // absolute offset read from the local header
+#define CDRREMOVED 0x02 // removed from the archive
+#define CDRWRITING 0x04 // being written, sizes & crc-32 aren't known yet
+#define CDRLOCAL64 0x08 // zip64 field in the local header, the data descriptor sizes are 8 bytes long
+
+// deflate doesn't expand the data more than 1032:1
+#define DEFLATEMAX 1032
+
+// central directory registers stored by columns ( indexed by identifier )
+typedef struct cdr_store{
+    std::vector<zconf::uint16> _version;            // version made by                 2 bytes
+    std::vector<zconf::uint16> _version_needed;     // version needed to extract       2 bytes
+    std::vector<zconf::uint16> _flag;               // general purpose bit flag        2 bytes
+    std::vector<zconf::uint16> _compression_method; // compression method              2 bytes
+    std::vector<zconf::uint32> _dos_date;           // last mod file date in DOS fmt   4 bytes
+    std::vector<zconf::uint32> _crc;                // crc-32                          4 bytes
+    std::vector<zconf::uint64> _compressed_size;    // compressed size                 4 bytes ( zip64: 8 )
+    std::vector<zconf::uint64> _uncompressed_size;  // uncompressed size               4 bytes ( zip64: 8 )
+    std::vector<zconf::uint16> _name_length;        // filename length                 2 bytes
+    std::vector<zconf::uint16> _extra_length;       // extra field length              2 bytes
+    std::vector<zconf::uint16> _comment_length;     // file comment length             2 bytes
+    std::vector<zconf::uint32> _disk_num_start;     // disk number start               2 bytes ( zip64: 4 )
+    std::vector<zconf::uint16> _internal_fa;        // internal file attributes        2 bytes
+    std::vector<zconf::uint32> _external_fa;        // external file attributes        4 bytes
+    std::vector<zconf::uint64> _relative_offset;    // relative offset to the local    4 bytes ( zip64: 8 )
     // ...
-    zip_tm        _tmu_date;             // date
-    std::string   _file_name;            // file name
-    std::string   _file_extra;           // file extra
-    std::string   _file_comment;         // file comment
-    zconf::uint32 _absolute_offset;      // absolute offset to the data     4 bytes
+    std::vector<zconf::uint64> _absolute_offset;    // absolute offset to the data
+    std::vector<zconf::uint64> _blob_offset;        // file name, extra & comment offset in the blob
+    std::vector<zconf::uint32> _name_hash;          // file name hash
+    std::vector<zconf::uint8>  _state;              // register state
+    std::string                _blob;               // file names, extras & comments
+
+    // number of registers
+    zconf::uint64 size( void ) const{
+        return _state.size();
+    }
+    // add an empty register
+    zconf::uint32 push( void ){
+        zconf::uint64 id = size(); resize( id + 1 ); return id;
+    }
+    // resize every column
+    void resize( zconf::uint64 n ){
+        _version.resize( n ); _version_needed.resize( n ); _flag.resize( n );
+        _compression_method.resize( n ); _dos_date.resize( n ); _crc.resize( n );
+        _compressed_size.resize( n ); _uncompressed_size.resize( n );
+        _name_length.resize( n ); _extra_length.resize( n ); _comment_length.resize( n );
+        _disk_num_start.resize( n ); _internal_fa.resize( n ); _external_fa.resize( n );
+        _relative_offset.resize( n ); _absolute_offset.resize( n ); _blob_offset.resize( n );
+        _name_hash.resize( n ); _state.resize( n );
+    }
+    // reserve every column
+    void reserve( zconf::uint64 n, zconf::uint64 blob ){
+        _version.reserve( n ); _version_needed.reserve( n ); _flag.reserve( n );
+        _compression_method.reserve( n ); _dos_date.reserve( n ); _crc.reserve( n );
+        _compressed_size.reserve( n ); _uncompressed_size.reserve( n );
+        _name_length.reserve( n ); _extra_length.reserve( n ); _comment_length.reserve( n );
+        _disk_num_start.reserve( n ); _internal_fa.reserve( n ); _external_fa.reserve( n );
+        _relative_offset.reserve( n ); _absolute_offset.reserve( n ); _blob_offset.reserve( n );
+        _name_hash.reserve( n ); _state.reserve( n ); _blob.reserve( blob );
+    }
+    // file name, extra & comment pointers
+    const zconf::byte *name( zconf::uint32 id ) const{
+        return _blob.data() + _blob_offset[ id ];
+    }
+    const zconf::byte *extra( zconf::uint32 id ) const{
+        return name( id ) + _name_length[ id ];
+    }
+    const zconf::byte *comment( zconf::uint32 id ) const{
+        return extra( id ) + _extra_length[ id ];
+    }
 };
 
 // CODE COMMENT FOOTER (2) <<
 
+// replace the saturated fields with the zip64 extended information
+static void read_zip64_extra( cdr_store &cdr, zconf::uint32 id ){
+	const zconf::byte *extra = cdr.extra( id );
+	const zconf::byte *end = extra + cdr._extra_length[ id ];
+	// go through the extra fields
+	while( end - extra >= 4 ){
+		zconf::uint16 tag = le16( extra ), size = le16( extra + 2 );
+		const zconf::byte *field = extra + 4;
+		if( end - field < size ) return;
+		if( tag == ZIP64TAG ){
+			// only the saturated fields are present, in this order
+			const zconf::byte *fend = field + size;
+			if( cdr._uncompressed_size[ id ] == ZIP64U32 && fend - field >= 8 ){
+				cdr._uncompressed_size[ id ] = le64( field ); field += 8;
+			}
+			if( cdr._compressed_size[ id ] == ZIP64U32 && fend - field >= 8 ){
+				cdr._compressed_size[ id ] = le64( field ); field += 8;
+			}
+			if( cdr._relative_offset[ id ] == ZIP64U32 && fend - field >= 8 ){
+				cdr._relative_offset[ id ] = le64( field ); field += 8;
+			}
+			if( cdr._disk_num_start[ id ] == ZIP64U16 && fend - field >= 4 ){
+				cdr._disk_num_start[ id ] = le32( field );
+			}
+			return;
+		}
+		extra = field + size;
+	}
+}
+
+// end of the local space of an entry ( data descriptors are counted at their largest )
+static inline zconf::uint64 entry_end( const cdr_store &cdr, zconf::uint32 id ){
+	return cdr._absolute_offset[ id ] + cdr._compressed_size[ id ] + ( cdr._flag[ id ] & FLAGDD ? DD64SIZE : 0 );
+}
+
+// write the extra field of a central record, zip64 values are always rebuilt
+static void write_cdr_extra( std::string &out, const cdr_store &cdr, zconf::uint32 id ){
+	// only the saturated fields are present, in this order
+	std::string zip64;
+	if( cdr._uncompressed_size[ id ] >= ZIP64U32 ) put64( zip64, cdr._uncompressed_size[ id ] );
+	if( cdr._compressed_size[ id ] >= ZIP64U32 ) put64( zip64, cdr._compressed_size[ id ] );
+	if( cdr._relative_offset[ id ] >= ZIP64U32 ) put64( zip64, cdr._relative_offset[ id ] );
+	if( !zip64.empty() ){
+		put16( out, ZIP64TAG ); put16( out, zip64.size() ); out.append( zip64 );
+	}
+	// keep the rest of the fields that fit ( the zip64 one is never dropped )
+	const zconf::byte *extra = cdr.extra( id );
+	const zconf::byte *end = extra + cdr._extra_length[ id ];
+	while( end - extra >= 4 ){
+		zconf::uint16 tag = le16( extra ), size = le16( extra + 2 );
+		if( end - extra - 4 < size ) break;
+		if( tag != ZIP64TAG && out.size() + 4 + size <= ZIP64U16 ) out.append( extra, 4 + size );
+		extra += 4 + size;
+	}
+}
+
+// tell if an extra field has a zip64 field
+static bool has_zip64( const zconf::byte *extra, zconf::uint64 length ){
+	const zconf::byte *end = extra + length;
+	while( end - extra >= 4 ){
+		zconf::uint16 tag = le16( extra ), size = le16( extra + 2 );
+		if( tag == ZIP64TAG ) return true;
+		extra += 4 + size;
+	}
+	return false;
+}
+
+// hash of an entry name ( FNV-1a )
+static inline zconf::uint32 hash_name( const zconf::byte *name, zconf::uint64 length ){
+	zconf::uint32 hash = 2166136261u;
+	for( zconf::uint64 idx = 0; idx < length; idx++ ){
+		hash ^= static_cast<unsigned char>( name[ idx ] ); hash *= 16777619u;
+	}
+	return hash;
+}
+
 class sort_by_name{
 
 public:
-	bool operator()( const file_info_32* e1, const file_info_32* e2 ) const{
-		return e1->_file_name.compare( e2->_file_name ) < 0;
+	sort_by_name( const cdr_store &cdr ) : _cdr( cdr ){}
+
+	bool operator()( zconf::uint32 e1, zconf::uint32 e2 ) const{
+		zconf::uint16 l1 = _cdr._name_length[ e1 ], l2 = _cdr._name_length[ e2 ];
+		int cmp = std::memcmp( _cdr.name( e1 ), _cdr.name( e2 ), l1 < l2 ? l1 : l2 );
+		return cmp < 0 || ( cmp == 0 && l1 < l2 );
 	}
 
+private:
+	const cdr_store &_cdr;
+
 };
 
 class sort_by_offset{
 
 public:
-	bool operator()( const file_info_32* e1, const file_info_32* e2 ) const{
-		return e1->_relative_offset < e2->_relative_offset;
+	sort_by_offset( const cdr_store &cdr ) : _cdr( cdr ){}
+
+	bool operator()( zconf::uint32 e1, zconf::uint32 e2 ) const{
+		return _cdr._relative_offset[ e1 ] < _cdr._relative_offset[ e2 ];
 	}
 
+private:
+	const cdr_store &_cdr;
+
 };
 
 typedef struct ziparchive::core{
-    zconf::uint16 _disk_number;
-    zconf::uint16 _cdr_first_disk;
-    zconf::uint16 _number_cdr_on_disk;
-    zconf::uint16 _total_number_cdr;
-    zconf::uint32 _size_cdr;
-    zconf::uint32 _offset_cdr_start;
+    zconf::uint32 _disk_number;
+    zconf::uint32 _cdr_first_disk;
+    zconf::uint64 _number_cdr_on_disk;
+    zconf::uint64 _total_number_cdr;
+    zconf::uint64 _size_cdr;
+    zconf::uint64 _offset_cdr_start;
     zconf::uint16 _zip_comment_length;
 	std::string   _comment;
 
 	// other properties
 	std::string   _error;
 
-	// set of registers sorted by offset
-	std::set<file_info_32*, sort_by_offset> _entries_by_offset;
-	// set of registers sorted by name
-	std::set<file_info_32*, sort_by_name>   _entries_by_name;
+	// central directory registers
+	cdr_store                   _cdr;
+	// open addressing hash table of identifiers + 1 ( 0 when empty )
+	std::vector<zconf::uint32>  _slots;
+	// identifiers sorted by offset
+	std::vector<zconf::uint32>  _entries_by_offset;
+	// identifiers sorted by name
+	std::vector<zconf::uint32>  _entries_by_name;
 	// list of entries
-	std::list<zipentry *>                   _open_entries;
-
-	// stream and zip size at opening
-	std::fstream  _fstream;
-	zconf::uint32 _zipsize;
+	std::list<zipentry *>       _open_entries;
+	// closed entries, ready to be open again
+	std::list<zipentry *>       _idle_entries;
+	// zlib allocation hooks of the entries
+	alloc_func    _zalloc;
+	free_func     _zfree;
+	voidpf        _opaque;
+	// guards the open entries and the scratch buffer
+	std::mutex                  _mutex;
+#ifdef ZSTATS
+	// counters of the closed entries & latencies
+	zstats                      _stats;
+#endif
+
+	// positional source and zip size at opening
+	zsource       _source;
+	zconf::uint64 _zipsize;
+	// end of central directory record offset
+	zconf::uint64 _offset_ecd;
+	// scratch buffer for the source reads
+	std::string   _scratch;
+	// opening flags
+	zconf::uint32 _flags;
+	// the source can be written
+	bool          _writable;
+	// the central directory has to be written
+	bool          _dirty;
+	// entry written at the end of the local space ( -1 if there's none )
+	zconf::int64  _appending;
+	// free extents of the local space by offset & by size ( best fit )
+	std::map<zconf::uint64, zconf::uint64>      _free_by_offset;
+	std::multimap<zconf::uint64, zconf::uint64> _free_by_size;
+	// end of the local space ( ZIP64MAX while appending )
+	zconf::uint64 _local_end;
+	// the free extents were mapped
+	bool          _free_valid;
 };
 
 typedef struct zipentry::core{
 	// private members
+	ziparchive *_archive;
 	ziparchive::core *_acore;
-	// entry alias
-	file_info_32 *_entry;
+	// entry identifier
+	zconf::uint32 _id;
+	// register fields at opening ( the registers move while other entries are written )
+	std::string   _name, _comment;
+	zconf::uint32 _dos_date, _crc;
+	zconf::uint64 _compressed_size, _uncompressed_size;
 	// entry zstream
 	zstream _zstream;
 };
 
 ziparchive::ziparchive( void ){
 	_core = new core;
+	// set values to zero
+	_core->_flags = 0; _core->_writable = _core->_dirty = false; _core->_appending = -1;
+	_core->_local_end = 0; _core->_free_valid = false;
+	_core->_zalloc = Z_NULL; _core->_zfree = Z_NULL; _core->_opaque = Z_NULL;
 }
 
-ziparchive::ziparchive( const char *path ){
+ziparchive::ziparchive( const char *path, zconf::uint32 flags ){
 	_core = new core;
+	// set values to zero
+	_core->_flags = 0; _core->_writable = _core->_dirty = false; _core->_appending = -1;
+	_core->_local_end = 0; _core->_free_valid = false;
+	_core->_zalloc = Z_NULL; _core->_zfree = Z_NULL; _core->_opaque = Z_NULL;
 	// open the archive
-	open( path );
+	open( path, flags );
 }
 
 ziparchive::~ziparchive( void ){
-	close();
+	close(); clear();
 	// delete objects
+	while( !_core->_idle_entries.empty() ){
+		delete _core->_idle_entries.front(); _core->_idle_entries.pop_front();
+	}
 	delete _core;
 }
 
+zipentry *ziparchive::take_entry( zconf::uint32 id, zconf::uint32 flags ){
+	// closed entries are reused, list nodes included
+	if( _core->_idle_entries.empty() ) _core->_idle_entries.push_back( new zipentry( *this ) );
+	_core->_open_entries.splice( _core->_open_entries.end(), _core->_idle_entries, _core->_idle_entries.begin() );
+	zipentry *zip_entry = _core->_open_entries.back();
+	zip_entry->open( id, flags );
+	return zip_entry;
+}
+
+ziparchive &ziparchive::setalloc( alloc_func zalloc, free_func zfree, voidpf opaque ){
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	_core->_zalloc = zalloc; _core->_zfree = zfree; _core->_opaque = opaque;
+	// return object
+	return *this;
+}
+
 // get entry from archive
-zipentry *ziparchive::entry( const std::string &name, zconf::uint32 size, zconf::uint32 flags ){
+zipentry *ziparchive::entry( const std::string &name, zconf::uint64 size, zconf::uint32 flags ){
+	return entry( name.data(), name.length(), size, flags );
+}
+
+zipentry *ziparchive::entry( const char *name, zconf::uint64 length, zconf::uint64 size, zconf::uint32 flags ){
 	if( !( flags & ( zstream::frio | zstream::fwio ) ) ){
 		_core->_error = "ziparchive: the entry must be set to be read or written";
 		return 0;
 	}
 
-	// find the entry
-	file_info_32 key; key._file_name = name;
-	std::set<file_info_32*, sort_by_name>::iterator entry = _core->_entries_by_name.find( &key );
+	// the latencies include the wait for the lock
+	ZSTAT( zconf::uint64 start = zstats::now(); )
 
-	if( entry != _core->_entries_by_name.end() ){
-		if( (*entry)->_compression_method != 8 && (*entry)->_compression_method != 9 ){
+	// entries are open from many threads, the index of read only archives doesn't change
+	std::unique_lock<std::mutex> lock( _core->_mutex, std::defer_lock );
+	if( _core->_writable ) lock.lock();
+
+	// find the entry
+	ZSTAT( zconf::uint64 found = zstats::now(); )
+	zconf::int64 id = lookup( name, length );
+	ZSTAT( zconf::uint64 lookup_ns = zstats::now() - found; )
+	if( !lock.owns_lock() ) lock.lock();
+	ZSTAT( _core->_stats.lookup_ns.add( lookup_ns ); )
+
+	if( id >= 0 ){
+		zconf::uint16 method = _core->_cdr._compression_method[ id ];
+		if( method != 0 && method != 8 && method != 9 ){
 			_core->_error = "ziparchive: compression method not supported";
 			return 0;
 		}
 	}
 
 	if( flags == zstream::frio ){
-		if( entry != _core->_entries_by_name.end() ){
-			zipentry *zip_entry = new zipentry( *_core, **entry, flags );
-			_core->_open_entries.push_back( zip_entry );
+		if( id >= 0 ){
+			if( _core->_cdr._state[ id ] & CDRWRITING ){
+				_core->_error = "ziparchive: the entry is being written";
+				return 0;
+			}
+			// find where the data starts, the local header is read without the lock
+			cdr_store &cdr = _core->_cdr;
+			while( !( cdr._state[ id ] & CDRLOCATED ) ){
+				zconf::uint64 offset = cdr._relative_offset[ id ], absolute = 0;
+				zconf::uint16 flag = cdr._flag[ id ];
+				zconf::uint8 state = 0;
+				lock.unlock();
+				bool valid = read_local( offset, flag, absolute, state );
+				lock.lock();
+				// the entry may have been removed or moved meanwhile
+				if( cdr._state[ id ] & CDRREMOVED ){
+					_core->_error = "ziparchive: the entry was removed";
+					return 0;
+				}else if( cdr._relative_offset[ id ] != offset ){
+					continue;
+				}else if( !valid ){
+					_core->_error = "ziparchive: a local file header signature is incorrect";
+					return 0;
+				}
+				cdr._absolute_offset[ id ] = absolute; cdr._state[ id ] |= state;
+			}
 			// return entry
-			return zip_entry;
+			zipentry *opened = take_entry( id, flags );
+			ZSTAT( if( opened != 0 ) _core->_stats.open_ns.add( zstats::now() - start ); )
+			return opened;
 		}else{
 			return 0;
 		}
+	}else if( _core->_source.is_mapped() ){
+		_core->_error = "ziparchive: a mapped archive can not be written";
+		return 0;
+	}else if( !_core->_writable ){
+		_core->_error = "ziparchive: the archive is read only";
+		return 0;
+	}else if( size == 0 && _core->_appending >= 0 ){
+		_core->_error = "ziparchive: another entry is being written at the end of the archive";
+		return 0;
+	}else if( length > ZIP64U16 ){
+		_core->_error = "ziparchive: the entry name is too long";
+		return 0;
 	}else{
 		// check if it's being used
 		std::list<zipentry *>::iterator open_entry = _core->_open_entries.begin();
 		// go throught the open entries
-		while( open_entry != _core->_open_entries.end() ){
-			if( !(*open_entry)->_core->_entry->_file_name.compare( name ) ){
+		while( id >= 0 && open_entry != _core->_open_entries.end() ){
+			if( (*open_entry)->_core->_id == id ){
 				_core->_error = "ziparchive: the entry is already open; you can not modify it!";
 				return 0;
 			}
 			open_entry++; // open next entry
 		}
 
-		// remove entry
-		if( entry != _core->_entries_by_name.end() ){
-			_core->_entries_by_name.erase( *entry );
-			_core->_entries_by_offset.erase( *entry );
-			delete *entry;
+		// the local space is measured from the local headers
+		if( !map_free() ) return 0;
+		// streamed entries & the ones that may inflate past 4 GB get a zip64 field with zero sizes
+		bool local64 = size == 0 || size >= ( flags & zstream::fraw ? ZIP64U32 : ZIP64U32 / DEFLATEMAX );
+		zconf::uint64 extra_length = local64 ? 20 : 0;
+		// remove the entry first, its own space can take the new one
+		if( id >= 0 ){
+			remove( id ); _core->_dirty = true;
+		}
+		// find a gap ( local header, data & descriptor ), unknown sizes go to the end
+		zconf::uint64 needed = size ? LFHSIZE + length + extra_length + size + DD64SIZE : 0;
+		zconf::uint64 offset = find_gap( needed );
+		if( offset == ZIP64MAX ){
+			_core->_error = "ziparchive: there's no space before the entry being written at the end";
+			return 0;
 		}
 
-		// create cdr entry
-		file_info_32 *cdr_entry = new file_info_32;
-		//...
+		// create cdr entry ( sizes & crc-32 go to the data descriptor )
+		cdr_store &cdr = _core->_cdr;
+		zconf::uint32 cdr_entry = cdr.push();
+		cdr._blob_offset[ cdr_entry ]        = cdr._blob.size();
+		cdr._name_length[ cdr_entry ]        = length;
+		cdr._name_hash[ cdr_entry ]          = hash_name( name, length );
+		cdr._blob.append( name, length );
+		cdr._version[ cdr_entry ]            = VERSION20;
+		cdr._version_needed[ cdr_entry ]     = local64 ? VERSION45 : VERSION20;
+		cdr._flag[ cdr_entry ]               = FLAGDD;
+		cdr._compression_method[ cdr_entry ] = ( flags & zstream::fraw ) ? 0 : 8;
+		cdr._dos_date[ cdr_entry ]           = now();
+		// the reserved space keeps the gap until it's closed
+		cdr._compressed_size[ cdr_entry ]    = size;
+		cdr._relative_offset[ cdr_entry ]    = offset;
+		cdr._absolute_offset[ cdr_entry ]    = offset + LFHSIZE + length + extra_length;
+		cdr._state[ cdr_entry ]              = CDRLOCATED | CDRWRITING | ( local64 ? CDRLOCAL64 : 0 );
+
+		// write the local file header
+		std::string header;
+		put32( header, LFHSIGN ); put16( header, cdr._version_needed[ cdr_entry ] ); put16( header, FLAGDD );
+		put16( header, cdr._compression_method[ cdr_entry ] ); put32( header, cdr._dos_date[ cdr_entry ] );
+		put32( header, 0 ); put32( header, 0 ); put32( header, 0 );
+		put16( header, length ); put16( header, extra_length );
+		header.append( name, length );
+		if( local64 ){
+			put16( header, ZIP64TAG ); put16( header, 16 ); put64( header, 0 ); put64( header, 0 );
+		}
+		if( _core->_source.pwrite( header.data(), header.size(), offset ) != header.size() ){
+			_core->_error = "ziparchive: wasn't able to write the local file header";
+			cdr._state[ cdr_entry ] |= CDRREMOVED;
+			// give the space back
+			if( size == 0 ) _core->_local_end = offset;
+			else release( offset, offset + needed );
+			return 0;
+		}
+
+		// add entry to the index
+		insert( cdr_entry ); _core->_dirty = true;
+		if( size == 0 ) _core->_appending = cdr_entry;
 
-		// find a gap!!
-		zconf::uint32 local_size    = size + LFHSIZE + name.length();
-		cdr_entry->_relative_offset = find_gap( local_size );
-		cdr_entry->_absolute_offset = cdr_entry->_relative_offset + local_size;
+		// return entry
+		zipentry *opened = take_entry( cdr_entry, flags );
+		ZSTAT( if( opened != 0 ) _core->_stats.open_ns.add( zstats::now() - start ); )
+		return opened;
+	}
+}
 
-		// add entry to sets
-		_core->_entries_by_name.insert( cdr_entry );
-		_core->_entries_by_offset.insert( cdr_entry );
+zconf::int64 ziparchive::lookup( const char *name, zconf::uint64 length ) const{
+	if( _core->_slots.empty() ) return -1;
+	// probe from the home slot
+	const zconf::uint64 mask = _core->_slots.size() - 1;
+	const zconf::uint32 hash = hash_name( name, length );
+	for( zconf::uint64 slot = hash & mask;; slot = ( slot + 1 ) & mask ){
+		zconf::uint32 value = _core->_slots[ slot ];
+		if( value == 0 ) return -1;
+		// compare hashes before the names
+		const cdr_store &cdr = _core->_cdr;
+		if( cdr._name_hash[ value - 1 ] == hash && cdr._name_length[ value - 1 ] == length &&
+			!std::memcmp( cdr.name( value - 1 ), name, length ) ){
+			return value - 1;
+		}
+	}
+}
 
-		// create new entry
-		zipentry *zip_entry = new zipentry( *_core, *cdr_entry, flags );
-		_core->_open_entries.push_back( zip_entry );
+void ziparchive::insert( zconf::uint32 id ){
+	// keep the hash table half empty at most
+	if( ( _core->_entries_by_name.size() + 1 ) * 2 > _core->_slots.size() ){
+		rehash( ( _core->_entries_by_name.size() + 1 ) * 2 );
+	}
+	hash_insert( id );
+	// keep the ordered views sorted
+	std::vector<zconf::uint32>::iterator position;
+	position = std::upper_bound( _core->_entries_by_name.begin(), _core->_entries_by_name.end(),
+		id, sort_by_name( _core->_cdr ) );
+	_core->_entries_by_name.insert( position, id );
+	position = std::upper_bound( _core->_entries_by_offset.begin(), _core->_entries_by_offset.end(),
+		id, sort_by_offset( _core->_cdr ) );
+	_core->_entries_by_offset.insert( position, id );
+}
 
-		// return entry
-		return zip_entry;
+void ziparchive::remove( zconf::uint32 id ){
+	// remove the identifier from the hash table
+	const zconf::uint64 mask = _core->_slots.size() - 1;
+	zconf::uint64 slot = _core->_cdr._name_hash[ id ] & mask;
+	while( _core->_slots[ slot ] != 0 && _core->_slots[ slot ] != id + 1 ) slot = ( slot + 1 ) & mask;
+	if( _core->_slots[ slot ] != 0 ){
+		_core->_slots[ slot ] = 0;
+		// shift back the following cluster ( no tombstones )
+		for( zconf::uint64 next = ( slot + 1 ) & mask; _core->_slots[ next ] != 0; next = ( next + 1 ) & mask ){
+			zconf::uint64 home = _core->_cdr._name_hash[ _core->_slots[ next ] - 1 ] & mask;
+			bool stays = ( slot <= next ) ? ( slot < home && home <= next ) : ( slot < home || home <= next );
+			if( !stays ){
+				_core->_slots[ slot ] = _core->_slots[ next ];
+				_core->_slots[ next ] = 0; slot = next;
+			}
+		}
+	}
+	// remove the identifier from the ordered views
+	std::vector<zconf::uint32>::iterator position, end;
+	position = std::lower_bound( _core->_entries_by_name.begin(), _core->_entries_by_name.end(),
+		id, sort_by_name( _core->_cdr ) );
+	end = std::upper_bound( position, _core->_entries_by_name.end(), id, sort_by_name( _core->_cdr ) );
+	position = std::find( position, end, id );
+	if( position != end ) _core->_entries_by_name.erase( position );
+	position = std::lower_bound( _core->_entries_by_offset.begin(), _core->_entries_by_offset.end(),
+		id, sort_by_offset( _core->_cdr ) );
+	end = std::upper_bound( position, _core->_entries_by_offset.end(), id, sort_by_offset( _core->_cdr ) );
+	position = std::find( position, end, id );
+	if( position != end ){
+		// free its local space, up to the next entry at most
+		if( _core->_free_valid ){
+			zconf::uint64 limit = entry_end( _core->_cdr, id );
+			if( position + 1 != _core->_entries_by_offset.end() && _core->_cdr._relative_offset[ *( position + 1 ) ] < limit ){
+				limit = _core->_cdr._relative_offset[ *( position + 1 ) ];
+			}
+			release( _core->_cdr._relative_offset[ id ], limit );
+		}
+		_core->_entries_by_offset.erase( position );
+	}
+	// mark the register
+	_core->_cdr._state[ id ] |= CDRREMOVED;
+}
+
+bool ziparchive::hash_insert( zconf::uint32 id ){
+	const zconf::uint64 mask = _core->_slots.size() - 1;
+	const cdr_store &cdr = _core->_cdr;
+	for( zconf::uint64 slot = cdr._name_hash[ id ] & mask;; slot = ( slot + 1 ) & mask ){
+		zconf::uint32 value = _core->_slots[ slot ];
+		if( value == 0 ){
+			_core->_slots[ slot ] = id + 1; return true;
+		}
+		// the first register of a duplicated name wins
+		if( cdr._name_hash[ value - 1 ] == cdr._name_hash[ id ] &&
+			cdr._name_length[ value - 1 ] == cdr._name_length[ id ] &&
+			!std::memcmp( cdr.name( value - 1 ), cdr.name( id ), cdr._name_length[ id ] ) ){
+			return false;
+		}
+	}
+}
+
+void ziparchive::rehash( zconf::uint64 capacity ){
+	// power of two capacity
+	zconf::uint64 size = 16;
+	while( size < capacity ) size <<= 1;
+	// rebuild the table
+	_core->_slots.assign( size, 0 );
+	for( zconf::uint64 idx = 0; idx < _core->_entries_by_name.size(); idx++ ){
+		hash_insert( _core->_entries_by_name[ idx ] );
+	}
+}
+
+void ziparchive::clear( void ){
+	_core->_cdr = cdr_store(); _core->_slots.clear();
+	_core->_entries_by_name.clear(); _core->_entries_by_offset.clear();
+	_core->_free_by_offset.clear(); _core->_free_by_size.clear(); _core->_free_valid = false;
+}
+
+bool ziparchive::map_free( void ){
+	if( _core->_free_valid ) return true;
+	if( !locate_all() ) return false;
+	_core->_free_by_offset.clear(); _core->_free_by_size.clear();
+	// the holes between the local records
+	const cdr_store &cdr = _core->_cdr;
+	const std::vector<zconf::uint32> &entries = _core->_entries_by_offset;
+	zconf::uint64 last = 0;
+	for( zconf::uint64 idx = 0; idx < entries.size(); idx++ ){
+		if( cdr._relative_offset[ entries[ idx ] ] > last ){
+			zconf::uint64 size = cdr._relative_offset[ entries[ idx ] ] - last;
+			_core->_free_by_offset[ last ] = size;
+			_core->_free_by_size.insert( std::make_pair( size, last ) );
+		}
+		if( entry_end( cdr, entries[ idx ] ) > last ) last = entry_end( cdr, entries[ idx ] );
+	}
+	_core->_local_end = last; _core->_free_valid = true;
+	return true;
+}
+
+void ziparchive::unmap_free( zconf::uint64 offset, zconf::uint64 size ){
+	_core->_free_by_offset.erase( offset );
+	std::multimap<zconf::uint64, zconf::uint64>::iterator extent = _core->_free_by_size.lower_bound( size );
+	while( extent != _core->_free_by_size.end() && extent->second != offset ) extent++;
+	if( extent != _core->_free_by_size.end() ) _core->_free_by_size.erase( extent );
+}
+
+void ziparchive::release( zconf::uint64 start, zconf::uint64 end ){
+	if( end <= start ) return;
+	std::map<zconf::uint64, zconf::uint64> &extents = _core->_free_by_offset;
+	// join the following extent
+	std::map<zconf::uint64, zconf::uint64>::iterator next = extents.lower_bound( start );
+	if( next != extents.end() && next->first <= end ){
+		if( next->first + next->second > end ) end = next->first + next->second;
+		unmap_free( next->first, next->second );
+	}
+	// join the previous extent
+	std::map<zconf::uint64, zconf::uint64>::iterator previous = extents.lower_bound( start );
+	if( previous != extents.begin() && ( --previous )->first + previous->second >= start ){
+		start = previous->first;
+		if( previous->first + previous->second > end ) end = previous->first + previous->second;
+		unmap_free( previous->first, previous->second );
+	}
+	// the local space shrinks or a hole is left
+	if( end >= _core->_local_end ){
+		_core->_local_end = start;
+	}else{
+		extents[ start ] = end - start;
+		_core->_free_by_size.insert( std::make_pair( end - start, start ) );
+	}
+}
+
+zconf::uint64 ziparchive::find_gap( zconf::uint64 size ){
+	// unknown sizes take the end of the local space
+	if( size == 0 ){
+		zconf::uint64 offset = _core->_local_end;
+		_core->_local_end = ZIP64MAX;
+		return offset;
+	}
+	// the smallest hole that fits
+	std::multimap<zconf::uint64, zconf::uint64>::iterator best = _core->_free_by_size.lower_bound( size );
+	if( best != _core->_free_by_size.end() ){
+		zconf::uint64 offset = best->second, length = best->first;
+		_core->_free_by_size.erase( best ); _core->_free_by_offset.erase( offset );
+		if( length > size ){
+			_core->_free_by_offset[ offset + size ] = length - size;
+			_core->_free_by_size.insert( std::make_pair( length - size, offset + size ) );
+		}
+		return offset;
+	}
+	// nothing fits after the entry written at the end
+	if( _core->_local_end == ZIP64MAX ) return ZIP64MAX;
+	zconf::uint64 offset = _core->_local_end;
+	_core->_local_end += size;
+	return offset;
+}
+
+zconf::uint32 ziparchive::now( void ){
+	std::time_t seconds = std::time( 0 );
+	const std::tm *local = std::localtime( &seconds );
+	// dates before 1980 can't be stored
+	zip_tm timestamp;
+	timestamp.tm_year = local->tm_year + 1900 < 1980 ? 1980 : local->tm_year + 1900;
+	timestamp.tm_mon  = local->tm_mon + 1; timestamp.tm_mday = local->tm_mday;
+	timestamp.tm_hour = local->tm_hour; timestamp.tm_min = local->tm_min; timestamp.tm_sec = local->tm_sec;
+	return timestamp2dosbin( timestamp );
+}
+
+bool ziparchive::finish( zconf::uint32 id, const zstream &stream ){
+	cdr_store &cdr = _core->_cdr;
+	cdr._state[ id ] &= ~CDRWRITING;
+	bool appending = static_cast<zconf::int64>( id ) == _core->_appending;
+	if( appending ) _core->_appending = -1;
+	_core->_dirty = true;
+	// failed entries give their space back
+	zconf::uint64 csize = stream.zoffset() - cdr._absolute_offset[ id ];
+	zconf::uint64 reserved = cdr._compressed_size[ id ];
+	if( stream.flags() & zstream::ferr ){
+		if( appending ) _core->_local_end = cdr._relative_offset[ id ];
+		remove( id ); return false;
+	}
+	cdr._crc[ id ] = stream.crc();
+	cdr._compressed_size[ id ] = csize; cdr._uncompressed_size[ id ] = stream.tcount();
+	// write the data descriptor ( zip64 sizes if the local header says so or they don't fit )
+	bool zip64 = ( cdr._state[ id ] & CDRLOCAL64 ) || csize >= ZIP64U32 || stream.tcount() >= ZIP64U32;
+	std::string descriptor;
+	put32( descriptor, ELFHSIGN ); put32( descriptor, cdr._crc[ id ] );
+	if( zip64 ){
+		put64( descriptor, csize ); put64( descriptor, stream.tcount() );
+		cdr._version_needed[ id ] = VERSION45; cdr._version[ id ] = VERSION45;
+	}else{
+		put32( descriptor, csize ); put32( descriptor, stream.tcount() );
+	}
+	if( _core->_source.pwrite( descriptor.data(), descriptor.size(), cdr._absolute_offset[ id ] + csize ) != descriptor.size() ){
+		_core->_error = "ziparchive: wasn't able to write the data descriptor";
+		if( appending ) _core->_local_end = cdr._relative_offset[ id ];
+		cdr._compressed_size[ id ] = reserved;
+		remove( id ); return false;
+	}
+	// the local space ends here or the rest of the reserve is free
+	if( appending ){
+		_core->_local_end = entry_end( cdr, id );
+	}else if( _core->_free_valid && csize < reserved ){
+		release( entry_end( cdr, id ), cdr._absolute_offset[ id ] + reserved + DD64SIZE );
+	}
+	return true;
+}
+
+bool ziparchive::write_cdr( void ){
+	if( !_core->_dirty ) return true;
+	// every register must be complete
+	std::list<zipentry *>::iterator open_entry = _core->_open_entries.begin();
+	for( ; open_entry != _core->_open_entries.end(); open_entry++ ){
+		if( _core->_cdr._state[ (*open_entry)->_core->_id ] & CDRWRITING ){
+			_core->_error = "ziparchive: entries are still being written";
+			return false;
+		}
+	}
+	if( !locate_all() ) return false;
+	const cdr_store &cdr = _core->_cdr;
+	const std::vector<zconf::uint32> &entries = _core->_entries_by_offset;
+	// the directory goes after the last entry
+	zconf::uint64 start = 0;
+	for( zconf::uint64 idx = 0; idx < entries.size(); idx++ ){
+		zconf::uint64 end = idx + 1 < entries.size() ? entry_end( cdr, entries[ idx ] ) : local_end( entries[ idx ] );
+		if( end > start ) start = end;
+	}
+	// central directory records
+	std::string out, extra;
+	out.reserve( entries.size() * CDFHSIZE + cdr._blob.size() );
+	for( zconf::uint64 idx = 0; idx < entries.size(); idx++ ){
+		zconf::uint32 id = entries[ idx ];
+		extra.clear(); write_cdr_extra( extra, cdr, id );
+		bool zip64 = extra.size() > 0 && le16( extra.data() ) == ZIP64TAG;
+		zconf::uint16 needed = cdr._version_needed[ id ];
+		if( zip64 && needed < VERSION45 ) needed = VERSION45;
+		put32( out, ECDFHSIGN ); put16( out, cdr._version[ id ] ); put16( out, needed );
+		put16( out, cdr._flag[ id ] ); put16( out, cdr._compression_method[ id ] );
+		put32( out, cdr._dos_date[ id ] ); put32( out, cdr._crc[ id ] );
+		put32( out, cdr._compressed_size[ id ] >= ZIP64U32 ? ZIP64U32 : cdr._compressed_size[ id ] );
+		put32( out, cdr._uncompressed_size[ id ] >= ZIP64U32 ? ZIP64U32 : cdr._uncompressed_size[ id ] );
+		put16( out, cdr._name_length[ id ] ); put16( out, extra.size() ); put16( out, cdr._comment_length[ id ] );
+		put16( out, 0 ); put16( out, cdr._internal_fa[ id ] ); put32( out, cdr._external_fa[ id ] );
+		put32( out, cdr._relative_offset[ id ] >= ZIP64U32 ? ZIP64U32 : cdr._relative_offset[ id ] );
+		out.append( cdr.name( id ), cdr._name_length[ id ] ); out.append( extra );
+		out.append( cdr.comment( id ), cdr._comment_length[ id ] );
+	}
+	zconf::uint64 size_cdr = out.size(), number = entries.size();
+	// zip64 ending records
+	_core->_offset_ecd = start + size_cdr;
+	if( number >= ZIP64U16 || size_cdr >= ZIP64U32 || start >= ZIP64U32 ){
+		put32( out, ECD64SIGN ); put64( out, ECD64SIZE - 12 ); put16( out, VERSION45 ); put16( out, VERSION45 );
+		put32( out, 0 ); put32( out, 0 ); put64( out, number ); put64( out, number );
+		put64( out, size_cdr ); put64( out, start );
+		put32( out, ECDL64SIGN ); put32( out, 0 ); put64( out, start + size_cdr ); put32( out, 1 );
+		_core->_offset_ecd += ECD64SIZE + ECDL64SIZE;
 	}
+	// ending record
+	put32( out, ECDSIGN ); put16( out, 0 ); put16( out, 0 );
+	put16( out, number >= ZIP64U16 ? ZIP64U16 : number ); put16( out, number >= ZIP64U16 ? ZIP64U16 : number );
+	put32( out, size_cdr >= ZIP64U32 ? ZIP64U32 : size_cdr ); put32( out, start >= ZIP64U32 ? ZIP64U32 : start );
+	put16( out, _core->_comment.size() ); out.append( _core->_comment );
+	// write everything at once and cut the rest
+	if( _core->_source.pwrite( out.data(), out.size(), start ) != out.size() ){
+		_core->_error = "ziparchive: wasn't able to write the central directory";
+		return false;
+	}
+	_core->_source.truncate( start + out.size() );
+	// refresh the ending values
+	_core->_disk_number = 0; _core->_cdr_first_disk = 0;
+	_core->_number_cdr_on_disk = _core->_total_number_cdr = number;
+	_core->_size_cdr = size_cdr; _core->_offset_cdr_start = start;
+	_core->_zip_comment_length = _core->_comment.size();
+	_core->_zipsize = start + out.size(); _core->_dirty = false;
+	if( _core->_free_valid ) _core->_local_end = start;
+	return true;
+}
+
+zconf::uint64 ziparchive::local_end( zconf::uint32 id ){
+	const cdr_store &cdr = _core->_cdr;
+	zconf::uint64 end = cdr._absolute_offset[ id ] + cdr._compressed_size[ id ];
+	if( !( cdr._flag[ id ] & FLAGDD ) ) return end;
+	// the signature is optional, zip64 sizes are 8 bytes long
+	const zconf::byte *descriptor = fetch( end, 4 );
+	if( descriptor == 0 ) return end + DD64SIZE;
+	bool zip64 = ( cdr._state[ id ] & CDRLOCAL64 ) ||
+		cdr._compressed_size[ id ] >= ZIP64U32 || cdr._uncompressed_size[ id ] >= ZIP64U32;
+	return end + ( le32( descriptor ) == ELFHSIGN ? 4 : 0 ) + ( zip64 ? DD64SIZE : DDSIZE ) - 4;
+}
+
+ziparchive &ziparchive::defrag( void ){
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	if( !_core->_writable || _core->_source.is_mapped() ){
+		_core->_error = "ziparchive: the archive is read only";
+		return *this;
+	}else if( !_core->_open_entries.empty() ){
+		_core->_error = "ziparchive: the entries must be closed before the defrag";
+		return *this;
+	}else if( !locate_all() ){
+		return *this;
+	}
+	cdr_store &cdr = _core->_cdr;
+	const std::vector<zconf::uint32> &entries = _core->_entries_by_offset;
+	// entries sharing data can't be moved apart
+	std::vector<zconf::uint64> ends( entries.size() );
+	for( zconf::uint64 idx = 0; idx < entries.size(); idx++ ){
+		ends[ idx ] = local_end( entries[ idx ] );
+		if( idx > 0 && cdr._relative_offset[ entries[ idx ] ] < ends[ idx - 1 ] ){
+			_core->_error = "ziparchive: the local entries overlap";
+			return *this;
+		}
+	}
+	// slide the entries to the front, raw as they are
+	zconf::uint64 cursor = 0;
+	for( zconf::uint64 idx = 0; idx < entries.size(); idx++ ){
+		zconf::uint32 id = entries[ idx ];
+		zconf::uint64 start = cdr._relative_offset[ id ], length = ends[ idx ] - start;
+		if( start != cursor ){
+			if( _core->_source.move( cursor, start, length ) != length ){
+				_core->_error = "ziparchive: wasn't able to move an entry";
+				break;
+			}
+			cdr._absolute_offset[ id ] -= start - cursor;
+			cdr._relative_offset[ id ] = cursor;
+			_core->_dirty = true;
+		}
+		cursor += length;
+	}
+	// there are no holes left, the free extents are mapped again on writing
+	_core->_free_by_offset.clear(); _core->_free_by_size.clear(); _core->_free_valid = false;
+	// the directory follows the last entry
+	write_cdr();
+	// return object
+	return *this;
 }
 
-zconf::uint32 ziparchive::find_gap( zconf::uint32 size ){
-	// check if it's being used
-	std::set<file_info_32*, sort_by_offset>::iterator entry = _core->_entries_by_offset.begin();
-	zconf::uint32 last_gap_start = 0;
-	// go throught the open entries
-	while( entry != _core->_entries_by_offset.end() ){
-		if( ( (*entry)->_relative_offset - last_gap_start ) >= size ) return last_gap_start;
-		last_gap_start = (*entry)->_absolute_offset + (*entry)->_compressed_size;
-		entry++; // next entry
+bool ziparchive::read( const std::string &name, std::string &data ){
+	zipentry *zip_entry = entry( name );
+	if( zip_entry == 0 ){
+		std::lock_guard<std::mutex> lock( _core->_mutex );
+		if( lookup( name.data(), name.length() ) < 0 ) _core->_error = "ziparchive: the entry wasn't found";
+		return false;
+	}
+	// the caller's buffer takes the whole entry
+	zconf::uint64 usize = zip_entry->uncompressed_size();
+	data.resize( usize );
+	if( usize > 0 ) zip_entry->read( &data[0], usize );
+	bool done = !( zip_entry->flags() & zstream::ferr ) && zip_entry->gcount() == usize;
+	if( !done ){
+		std::lock_guard<std::mutex> lock( _core->_mutex );
+		_core->_error = zip_entry->error().empty() ? "ziparchive: the entry is shorter than expected" : zip_entry->error();
 	}
-	// return last gat start
-	return last_gap_start;
+	zip_entry->close();
+	return done;
 }
 
-ziparchive &ziparchive::open( const char *path ){
-	// scanning index
-	zconf::uint32 sindex = 0;
+ziparchive &ziparchive::remove( const std::string &name ){
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	zconf::int64 id = lookup( name.data(), name.length() );
+	if( id < 0 ){
+		_core->_error = "ziparchive: the entry wasn't found";
+		return *this;
+	}else if( !_core->_writable || _core->_source.is_mapped() ){
+		_core->_error = "ziparchive: the archive is read only";
+		return *this;
+	}
+	// it can't be open
+	std::list<zipentry *>::iterator open_entry = _core->_open_entries.begin();
+	for( ; open_entry != _core->_open_entries.end(); open_entry++ ){
+		if( (*open_entry)->_core->_id == id ){
+			_core->_error = "ziparchive: the entry is already open; you can not modify it!";
+			return *this;
+		}
+	}
+	if( !map_free() ) return *this;
+	remove( id ); _core->_dirty = true;
+	// return object
+	return *this;
+}
 
-	// open stream
-	_core->_fstream.open( path, std::ios::in | std::ios::out | std::ios::binary | std::ios::app );
+ziparchive &ziparchive::copy( ziparchive &from, const std::string &name ){
+	if( &from == this ){
+		_core->_error = "ziparchive: an entry can't be copied into its own archive";
+		return *this;
+	}
+	std::unique_lock<std::mutex> lock( _core->_mutex, std::defer_lock ), from_lock( from._core->_mutex, std::defer_lock );
+	std::lock( lock, from_lock );
+	// the error is left empty when the entry is copied
+	_core->_error.clear();
+	if( !_core->_writable || _core->_source.is_mapped() ){
+		_core->_error = "ziparchive: the archive is read only";
+		return *this;
+	}else if( name.length() > ZIP64U16 ){
+		_core->_error = "ziparchive: the entry name is too long";
+		return *this;
+	}
+	// find the entry & its data
+	zconf::int64 source = from.lookup( name.data(), name.length() );
+	if( source < 0 ){
+		_core->_error = "ziparchive: the entry wasn't found";
+		return *this;
+	}else if( from._core->_cdr._state[ source ] & CDRWRITING ){
+		_core->_error = "ziparchive: the entry is being written";
+		return *this;
+	}else if( !from.locate( source ) ){
+		_core->_error = from._core->_error;
+		return *this;
+	}
+	// the entry it replaces can't be open
+	zconf::int64 id = lookup( name.data(), name.length() );
+	std::list<zipentry *>::iterator open_entry = _core->_open_entries.begin();
+	for( ; id >= 0 && open_entry != _core->_open_entries.end(); open_entry++ ){
+		if( (*open_entry)->_core->_id == id ){
+			_core->_error = "ziparchive: the entry is already open; you can not modify it!";
+			return *this;
+		}
+	}
+	if( !map_free() ) return *this;
+
+	// register the copy, the central extra field comes along
+	const cdr_store &fcdr = from._core->_cdr;
+	cdr_store &cdr = _core->_cdr;
+	zconf::uint32 cdr_entry = cdr.push();
+	cdr._blob_offset[ cdr_entry ]        = cdr._blob.size();
+	cdr._blob.append( fcdr.name( source ), fcdr._name_length[ source ] + fcdr._extra_length[ source ] + fcdr._comment_length[ source ] );
+	cdr._name_length[ cdr_entry ]        = fcdr._name_length[ source ];
+	cdr._extra_length[ cdr_entry ]       = fcdr._extra_length[ source ];
+	cdr._comment_length[ cdr_entry ]     = fcdr._comment_length[ source ];
+	cdr._name_hash[ cdr_entry ]          = fcdr._name_hash[ source ];
+	cdr._version[ cdr_entry ]            = fcdr._version[ source ];
+	cdr._version_needed[ cdr_entry ]     = fcdr._version_needed[ source ];
+	cdr._flag[ cdr_entry ]               = fcdr._flag[ source ];
+	cdr._compression_method[ cdr_entry ] = fcdr._compression_method[ source ];
+	cdr._dos_date[ cdr_entry ]           = fcdr._dos_date[ source ];
+	cdr._crc[ cdr_entry ]                = fcdr._crc[ source ];
+	cdr._compressed_size[ cdr_entry ]    = fcdr._compressed_size[ source ];
+	cdr._uncompressed_size[ cdr_entry ]  = fcdr._uncompressed_size[ source ];
+	cdr._internal_fa[ cdr_entry ]        = fcdr._internal_fa[ source ];
+	cdr._external_fa[ cdr_entry ]        = fcdr._external_fa[ source ];
+
+	// new local header, sizes go to the header or to a data descriptor
+	bool descriptor = cdr._flag[ cdr_entry ] & FLAGDD;
+	bool zip64 = cdr._compressed_size[ cdr_entry ] >= ZIP64U32 || cdr._uncompressed_size[ cdr_entry ] >= ZIP64U32 ||
+		( descriptor && ( fcdr._state[ source ] & CDRLOCAL64 ) );
+	if( zip64 && cdr._version_needed[ cdr_entry ] < VERSION45 ) cdr._version_needed[ cdr_entry ] = VERSION45;
+	std::string header;
+	put32( header, LFHSIGN ); put16( header, cdr._version_needed[ cdr_entry ] ); put16( header, cdr._flag[ cdr_entry ] );
+	put16( header, cdr._compression_method[ cdr_entry ] ); put32( header, cdr._dos_date[ cdr_entry ] );
+	if( descriptor ){
+		put32( header, 0 ); put32( header, 0 ); put32( header, 0 );
+	}else{
+		put32( header, cdr._crc[ cdr_entry ] );
+		put32( header, zip64 ? ZIP64U32 : cdr._compressed_size[ cdr_entry ] );
+		put32( header, zip64 ? ZIP64U32 : cdr._uncompressed_size[ cdr_entry ] );
+	}
+	put16( header, cdr._name_length[ cdr_entry ] ); put16( header, zip64 ? 20 : 0 );
+	header.append( cdr.name( cdr_entry ), cdr._name_length[ cdr_entry ] );
+	// the sizes of a data descriptor are zero here
+	if( zip64 ){
+		put16( header, ZIP64TAG ); put16( header, 16 );
+		put64( header, descriptor ? 0 : cdr._uncompressed_size[ cdr_entry ] );
+		put64( header, descriptor ? 0 : cdr._compressed_size[ cdr_entry ] );
+	}
+	std::string trailer;
+	if( descriptor ){
+		put32( trailer, ELFHSIGN ); put32( trailer, cdr._crc[ cdr_entry ] );
+		if( zip64 ){
+			put64( trailer, cdr._compressed_size[ cdr_entry ] ); put64( trailer, cdr._uncompressed_size[ cdr_entry ] );
+		}else{
+			put32( trailer, cdr._compressed_size[ cdr_entry ] ); put32( trailer, cdr._uncompressed_size[ cdr_entry ] );
+		}
+	}
 
-	// open archive
-	if( _core->_fstream.is_open() ){
-		// set the get pointer at the end of the file
-		_core->_fstream.seekg( 0, std::ios::end );
-		_core->_zipsize = _core->_fstream.tellg();
-		// find signature
-		sindex = find_signature( ECDSIGN, _core->_zipsize, false );
+	// the local record is measured as entry_end does
+	zconf::uint64 csize = cdr._compressed_size[ cdr_entry ];
+	zconf::uint64 needed = header.size() + csize + ( descriptor ? DD64SIZE : 0 );
+	// the replaced entry goes first, its own space can take the copy
+	if( id >= 0 ){
+		remove( id ); _core->_dirty = true;
+	}
+	zconf::uint64 offset = find_gap( needed );
+	if( offset == ZIP64MAX ){
+		_core->_error = "ziparchive: there's no space before the entry being written at the end";
+		cdr._state[ cdr_entry ] = CDRREMOVED;
+		return *this;
+	}
+	cdr._relative_offset[ cdr_entry ] = offset;
+	cdr._absolute_offset[ cdr_entry ] = offset + header.size();
+	cdr._state[ cdr_entry ]           = CDRLOCATED | ( zip64 && descriptor ? CDRLOCAL64 : 0 );
+	// header, raw data & descriptor
+	if( _core->_source.pwrite( header.data(), header.size(), offset ) != header.size() ||
+		from._core->_source.copyto( _core->_source, csize, fcdr._absolute_offset[ source ], offset + header.size() ) != csize ||
+		_core->_source.pwrite( trailer.data(), trailer.size(), offset + header.size() + csize ) != trailer.size() ){
+		_core->_error = "ziparchive: wasn't able to copy the entry";
+		cdr._state[ cdr_entry ] = CDRREMOVED;
+		release( offset, offset + needed );
+		return *this;
+	}
+
+	// add the copy to the index
+	insert( cdr_entry ); _core->_dirty = true;
+	// return object
+	return *this;
+}
+
+ziparchive &ziparchive::flush( void ){
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	write_cdr();
+	// return object
+	return *this;
+}
+
+ziparchive &ziparchive::open( const char *path, zconf::uint32 flags ){
+	// open or map the file
+	_core->_flags = flags; _core->_writable = _core->_dirty = false; _core->_appending = -1;
+	if( flags & fmap ){
+		_core->_source.open( path, zsource::fmap );
+	}else{
+		_core->_source.open( path, zsource::frio | zsource::fwio );
+		_core->_writable = _core->_source.is_open();
+		// fallback to read only
+		if( !_core->_source.is_open() ) _core->_source.open( path, zsource::frio );
+		// create it if it's asked to
+		if( !_core->_source.is_open() && ( flags & fcreate ) ){
+			_core->_source.open( path, zsource::frio | zsource::fwio | zsource::fnew );
+			_core->_writable = _core->_source.is_open();
+		}
+	}
+	_core->_zipsize = _core->_source.size();
+
+	// new archives are empty files
+	if( is_open() && _core->_zipsize == 0 && _core->_writable ){
+		clear(); rehash( 0 );
+		_core->_disk_number = _core->_cdr_first_disk = 0;
+		_core->_number_cdr_on_disk = _core->_total_number_cdr = 0;
+		_core->_size_cdr = _core->_offset_cdr_start = _core->_offset_ecd = 0;
+		_core->_zip_comment_length = 0; _core->_comment.clear();
+		// the ending record is written on closing
+		_core->_dirty = true;
+	}else if( is_open() ){
+		// locate the ending record
+		const zconf::byte *record = find_ecd();
 		// process data
-		if( sindex > 0 ){
-			sindex += 4;
-			// FOUND!! Update scanning index
-			_core->_fstream.seekg( sindex, std::ios::beg );
+		if( record != 0 ){
 			// read CDR ending record
-			_core->_fstream.read( reinterpret_cast<char*>( &_core->_disk_number ),        sizeof( zconf::uint16 ) );
-			_core->_fstream.read( reinterpret_cast<char*>( &_core->_cdr_first_disk ),     sizeof( zconf::uint16 ) );
-			_core->_fstream.read( reinterpret_cast<char*>( &_core->_number_cdr_on_disk ), sizeof( zconf::uint16 ) );
-			_core->_fstream.read( reinterpret_cast<char*>( &_core->_total_number_cdr ),   sizeof( zconf::uint16 ) );
-			_core->_fstream.read( reinterpret_cast<char*>( &_core->_size_cdr ),           sizeof( zconf::uint32 ) );
-			_core->_fstream.read( reinterpret_cast<char*>( &_core->_offset_cdr_start ),   sizeof( zconf::uint32 ) );
-			_core->_fstream.read( reinterpret_cast<char*>( &_core->_zip_comment_length ), sizeof( zconf::uint16 ) );
+			_core->_disk_number        = le16( record +  4 );
+			_core->_cdr_first_disk     = le16( record +  6 );
+			_core->_number_cdr_on_disk = le16( record +  8 );
+			_core->_total_number_cdr   = le16( record + 10 );
+			_core->_size_cdr           = le32( record + 12 );
+			_core->_offset_cdr_start   = le32( record + 16 );
+			_core->_zip_comment_length = le16( record + 20 );
 			// read zip comment
-			_core->_comment = std::string().append( _core->_zip_comment_length, ' ' );
-			_core->_fstream.read( &_core->_comment[0], _core->_zip_comment_length );
+			_core->_comment.assign( record + ECDSIZE, _core->_zip_comment_length );
 			// read the central directory records
-			read_cdr();
+			if( read_ecd64() ) read_cdr();
 		}else{
 			_core->_error = "ziparchive: zip file corrupted";
 		}
@@ -252,72 +1170,159 @@ ziparchive &ziparchive::open( const char *path ){
 	return *this;
 }
 
+zconf::bytep ziparchive::fetch( zconf::uint64 offset, zconf::uint64 size ){
+	// check boundaries ( the file grows while it's written )
+	if( offset > _core->_source.size() || size > _core->_source.size() - offset ) return 0;
+	// mapped archives are read in place
+	if( _core->_source.is_mapped() ) return const_cast<zconf::bytep>( _core->_source.view( offset, size ) );
+	// read into the scratch buffer
+	if( _core->_scratch.size() < size + 1 ) _core->_scratch.resize( size + 1 );
+	if( _core->_source.pread( &_core->_scratch[0], size, offset ) != size ) return 0;
+	return &_core->_scratch[0];
+}
+
+bool ziparchive::read_ecd64( void ){
+	// the locator is right before the ending record
+	if( _core->_offset_ecd < ECDL64SIZE ) return true;
+	const zconf::byte *locator = fetch( _core->_offset_ecd - ECDL64SIZE, ECDL64SIZE );
+	if( locator == 0 || le32( locator ) != ECDL64SIGN ) return true; // zip32
+	zconf::uint64 offset_ecd64 = le64( locator + 8 );
+	// read the zip64 ending record
+	const zconf::byte *record = fetch( offset_ecd64, ECD64SIZE );
+	if( record == 0 || le32( record ) != ECD64SIGN ){
+		_core->_error = "ziparchive: zip64 end of central directory record is corrupted";
+		close(); return false;
+	}
+	_core->_disk_number        = le32( record + 16 );
+	_core->_cdr_first_disk     = le32( record + 20 );
+	_core->_number_cdr_on_disk = le64( record + 24 );
+	_core->_total_number_cdr   = le64( record + 32 );
+	_core->_size_cdr           = le64( record + 40 );
+	_core->_offset_cdr_start   = le64( record + 48 );
+	// continue with the records
+	return true;
+}
+
+bool ziparchive::locate( zconf::uint32 id ){
+	cdr_store &cdr = _core->_cdr;
+	if( cdr._state[ id ] & CDRLOCATED ) return true;
+	zconf::uint8 state = 0;
+	if( !read_local( cdr._relative_offset[ id ], cdr._flag[ id ], cdr._absolute_offset[ id ], state ) ){
+		_core->_error = "ziparchive: a local file header signature is incorrect";
+		return false;
+	}
+	cdr._state[ id ] |= state;
+	return true;
+}
+
+bool ziparchive::read_local( zconf::uint64 offset, zconf::uint16 flag, zconf::uint64 &absolute, zconf::uint8 &state ) const{
+	// read the local file header ( on the stack, the scratch buffer needs the lock )
+	zconf::byte header[ LFHSIZE ];
+	if( _core->_source.pread( header, LFHSIZE, offset ) != LFHSIZE || le32( header ) != LFHSIGN ) return false;
+	// the local extra field may differ from the central one
+	zconf::uint16 name_length = le16( header + 26 ), extra_length = le16( header + 28 );
+	absolute = offset + LFHSIZE + name_length + extra_length;
+	state = CDRLOCATED;
+	// a local zip64 field makes the data descriptor sizes 8 bytes long
+	if( ( flag & FLAGDD ) && extra_length > 0 ){
+		std::string extra( extra_length, 0 );
+		zconf::bytep data = reinterpret_cast<zconf::bytep>( &extra[0] );
+		if( _core->_source.pread( data, extra_length, offset + LFHSIZE + name_length ) == extra_length &&
+			has_zip64( data, extra_length ) ) state |= CDRLOCAL64;
+	}
+	return true;
+}
+
+bool ziparchive::locate_all( void ){
+	const std::vector<zconf::uint32> &entries = _core->_entries_by_offset;
+	for( zconf::uint64 idx = 0; idx < entries.size(); idx++ ){
+		if( !locate( entries[ idx ] ) ) return false;
+	}
+	return true;
+}
+
 void ziparchive::read_cdr( void ){
-	zconf::uint32 sindex, lsindex, word, dos_date;
-	zconf::uint16 size_file_name, size_file_extra, size_file_comment;
-	// go to the start of the central directory records
-	_core->_fstream.seekg( _core->_offset_cdr_start, std::ios::beg );
-	// get index
-	sindex = _core->_fstream.tellg();
+	clear();
+	cdr_store &cdr = _core->_cdr;
+	// read the whole central directory at once ( the sizes of a damaged ending record are checked first )
+	const zconf::byte *cdr_data = fetch( _core->_offset_cdr_start, _core->_size_cdr );
+	if( cdr_data == 0 ){
+		_core->_error = "ziparchive: the central directory is out of bounds";
+		close(); return;
+	}
+	// reserve the registers, no more than the records that fit in the directory
+	zconf::uint64 total = _core->_total_number_cdr;
+	if( total > _core->_size_cdr / CDFHSIZE ) total = _core->_size_cdr / CDFHSIZE;
+	cdr.reserve( total, _core->_size_cdr );
 	// process central directories
-	for(;;){
-		// find the signature
-		if( ( sindex = find_signature( ECDFHSIGN, sindex ) ) <= 0 ){
-			break; // get out of the loop
+	const zconf::byte *cursor = cdr_data, *end = cdr_data + _core->_size_cdr;
+	while( cursor < end ){
+		// check the fixed part of the record
+		if( end - cursor < CDFHSIZE || le32( cursor ) != ECDFHSIGN ){
+			_core->_error = "ziparchive: a central directory record is corrupted";
+			close(); return;
+		}
+		zconf::uint16 size_file_name    = le16( cursor + 28 );
+		zconf::uint16 size_file_extra   = le16( cursor + 30 );
+		zconf::uint16 size_file_comment = le16( cursor + 32 );
+		zconf::uint32 size_fields = size_file_name + size_file_extra + size_file_comment;
+		// check the variable part of the record
+		if( end - cursor < CDFHSIZE + size_fields ){
+			_core->_error = "ziparchive: a central directory record is truncated";
+			close(); return;
 		}
-
-		// FOUND!! Update scanning index
-		sindex += 4; _core->_fstream.seekg( sindex, std::ios::beg );
 		// process the record
-		file_info_32 *file_info = new file_info_32;
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_version ), sizeof( zconf::uint16 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_version_needed ), sizeof( zconf::uint16 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_flag ), sizeof( zconf::uint16 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_compression_method ), sizeof( zconf::uint16 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &dos_date ), sizeof( zconf::uint32 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_crc ), sizeof( zconf::uint32 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_compressed_size ), sizeof( zconf::uint32 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_uncompressed_size ), sizeof( zconf::uint32 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &size_file_name ), sizeof( zconf::uint16 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &size_file_extra ), sizeof( zconf::uint16 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &size_file_comment ), sizeof( zconf::uint16 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_disk_num_start ), sizeof( zconf::uint16 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_internal_fa ), sizeof( zconf::uint16 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_external_fa ), sizeof( zconf::uint32 ) );
-	    _core->_fstream.read( reinterpret_cast<char*>( &file_info->_relative_offset ), sizeof( zconf::uint32 ) );
-	    // convert time stamp
-	    file_info->_tmu_date = dosbin2timestamp( dos_date );
-		// read file name
-	    file_info->_file_name = std::string().append( size_file_name, ' ' );
-		_core->_fstream.read( &file_info->_file_name[0], size_file_name );
-		// read file extra
-		file_info->_file_extra = std::string().append( size_file_extra, ' ' );
-		_core->_fstream.read( &file_info->_file_extra[0], size_file_extra );
-		// read file comment
-		file_info->_file_comment = std::string().append( size_file_comment, ' ' );
-		_core->_fstream.read( &file_info->_file_comment[0], size_file_comment );
-
-		// save context
-		// lsindex = file_info->_relative_offset;
-		sindex = _core->_fstream.tellg();
+		zconf::uint32 id = cdr.push();
+		cdr._version[ id ]            = le16( cursor +  4 );
+		cdr._version_needed[ id ]     = le16( cursor +  6 );
+		cdr._flag[ id ]               = le16( cursor +  8 );
+		cdr._compression_method[ id ] = le16( cursor + 10 );
+		cdr._dos_date[ id ]           = le32( cursor + 12 );
+		cdr._crc[ id ]                = le32( cursor + 16 );
+		cdr._compressed_size[ id ]    = le32( cursor + 20 );
+		cdr._uncompressed_size[ id ]  = le32( cursor + 24 );
+		cdr._name_length[ id ]        = size_file_name;
+		cdr._extra_length[ id ]       = size_file_extra;
+		cdr._comment_length[ id ]     = size_file_comment;
+		cdr._disk_num_start[ id ]     = le16( cursor + 34 );
+		cdr._internal_fa[ id ]        = le16( cursor + 36 );
+		cdr._external_fa[ id ]        = le32( cursor + 38 );
+		cdr._relative_offset[ id ]    = le32( cursor + 42 );
+		cursor += CDFHSIZE;
+		// copy file name, extra & comment to the blob
+		cdr._blob_offset[ id ] = cdr._blob.size();
+		cdr._name_hash[ id ]   = hash_name( cursor, size_file_name );
+		cdr._blob.append( cursor, size_fields ); cursor += size_fields;
+		// replace the saturated fields with the zip64 values
+		read_zip64_extra( cdr, id );
 
 		// CODE COMMENT FOOTER (1) <<
 
-		// set the absolute data offset
-		file_info->_absolute_offset = file_info->_relative_offset + LFHSIZE;
-		file_info->_absolute_offset = file_info->_absolute_offset + size_file_name + size_file_extra;
+		// estimate the absolute data offset ( resolved on opening )
+		cdr._absolute_offset[ id ] = cdr._relative_offset[ id ] + LFHSIZE + size_file_name + size_file_extra;
+	}
 
-		// add a new entry to the structures
-		_core->_entries_by_offset.insert( file_info );
-		_core->_entries_by_name.insert( file_info );
+	// build the hash table
+	rehash( cdr.size() * 2 );
+	// build the ordered views
+	_core->_entries_by_offset.resize( cdr.size() );
+	for( zconf::uint64 idx = 0; idx < cdr.size(); idx++ ){
+		_core->_entries_by_offset[ idx ] = idx;
+		if( hash_insert( idx ) ) _core->_entries_by_name.push_back( idx );
 	}
+	std::sort( _core->_entries_by_name.begin(), _core->_entries_by_name.end(), sort_by_name( cdr ) );
+	std::stable_sort( _core->_entries_by_offset.begin(), _core->_entries_by_offset.end(), sort_by_offset( cdr ) );
 
 	// construct gap structure
 	// ...
 }
 
-ziparchive &ziparchive::set_comment( const std::string &comment ) const{
-	_core->_comment = comment;
+ziparchive &ziparchive::set_comment( const std::string &comment ){
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	// the length is stored in 2 bytes
+	_core->_comment = comment.substr( 0, ZIP64U16 ); _core->_dirty = true;
+	// return object
+	return *this;
 }
 
 /*
@@ -366,46 +1371,135 @@ std::string ziparchive::timestamp2string( const zip_tm &timestamp ){
 	return sstream.str();
 }
 
-zconf::uint32 ziparchive::find_signature( zconf::uint32 sign, zconf::uint32 sindex, bool forewards ){
+const zconf::byte *ziparchive::find_ecd( void ){
+	// the record is followed by a comment of 64 KB at most
+	zconf::uint64 tsize = _core->_zipsize < ECDMAXTAIL ? _core->_zipsize : ECDMAXTAIL;
+	zconf::uint64 tstart = _core->_zipsize - tsize;
+	// read the tail at once
+	const zconf::byte *tail = fetch( tstart, tsize );
+	if( tail == 0 ) return 0;
+	// scan backwards for a record whose comment reaches the end of the file
+	zconf::int64 idx = tsize, loose = -1;
+	while( ( idx = scan_signature( tail, static_cast<zconf::uint64>( idx ) + 3 < tsize ? idx + 3 : tsize, ECDSIGN, false ) ) >= 0 ){
+		if( static_cast<zconf::uint64>( idx ) + ECDSIZE <= tsize ){
+			zconf::uint64 end = idx + ECDSIZE + le16( tail + idx + 20 );
+			if( end == tsize ){
+				_core->_offset_ecd = tstart + idx;
+				return tail + idx; // FOUND!!
+			}
+			// tolerate trailing garbage after the comment
+			if( end < tsize && loose < 0 ) loose = idx;
+		}
+		if( idx == 0 ) break;
+	}
+	// fallback to the last candidate inside the file
+	if( loose < 0 ) return 0;
+	_core->_offset_ecd = tstart + loose;
+	return tail + loose;
+}
+
+zconf::uint64 ziparchive::find_signature( zconf::uint32 sign, zconf::uint64 sindex, bool forewards ){
 	// scanning buffer size
-	const zconf::uint32 SBUFFERS = 32; char sbuffer[ SBUFFERS ];
+	const zconf::uint64 SBUFFERS = ZSCANSIZE;
 
 	// get local scanning index
-	zconf::int64 lsindex = sindex;
-	// once we have the offset of the file
-	if( !forewards ){
-		lsindex = ( lsindex - SBUFFERS > 0 ) ? lsindex - SBUFFERS : 0;
-	}
+	zconf::uint64 lsindex = sindex;
 
 	// scan for the signature
 	for( ;; ){
-		// check boundaries
-		if( forewards && ( lsindex >= _core->_zipsize ) ){
-			return 0;
-		}else if( !forewards && ( lsindex < 0 ) ){
-			return 0;
+		// calculate chunk
+		zconf::uint64 start, size;
+		if( forewards ){
+			if( lsindex + 4 > _core->_zipsize ) return 0;
+			start = lsindex;
+			size  = ( _core->_zipsize - lsindex < SBUFFERS ) ? _core->_zipsize - lsindex : SBUFFERS;
+		}else{
+			if( lsindex < 4 ) return 0;
+			start = ( lsindex > SBUFFERS ) ? lsindex - SBUFFERS : 0;
+			size  = lsindex - start;
 		}
-		// calculate chunk size
-		zconf::uint32 chunk_size = SBUFFERS;
-		if( lsindex + SBUFFERS >= _core->_zipsize )
-			chunk_size = _core->_zipsize - lsindex;
 		// read chunk
-		_core->_fstream.seekg( lsindex, std::ios::beg );
-		_core->_fstream.read( sbuffer, chunk_size );
+		const zconf::byte *sbuffer = fetch( start, size );
+		if( sbuffer == 0 ) return 0;
 		// find the signature
-		for( zconf::uint32 idx = 0; idx < chunk_size - 3; idx++ ){
-			// extract current word
-			zconf::uint32 word = *( (zconf::uint32 *)( sbuffer + idx ) );
-			// make comparison
-			if( word == sign ) return lsindex + idx;
-		}
-		// update index
+		zconf::int64 idx = scan_signature( sbuffer, size, sign, forewards );
+		if( idx >= 0 ) return start + idx;
+		// update index ( chunks overlap by 3 bytes )
 		if( forewards ){
-			lsindex = lsindex + SBUFFERS - 3;
+			if( start + size >= _core->_zipsize ) return 0;
+			lsindex = start + size - 3;
 		}else{
-			lsindex = lsindex - SBUFFERS + 3;
+			if( start == 0 ) return 0;
+			lsindex = start + 3;
+		}
+	}
+}
+
+zconf::int64 ziparchive::scan_signature( const zconf::byte *buffer, zconf::uint64 size,
+		zconf::uint32 sign, bool forewards ){
+	if( size < 4 ) return -1;
+	// last index where a signature fits
+	const zconf::int64 last = size - 4;
+	const zconf::byte b0 = sign & 0xff, b1 = ( sign >> 8 ) & 0xff;
+
+	if( forewards ){
+		zconf::int64 idx = 0;
+#ifdef ZSCAN_SSE2
+		// match the first two bytes of 16 candidates at once
+		const __m128i v0 = _mm_set1_epi8( b0 ), v1 = _mm_set1_epi8( b1 );
+		for( ; idx + 16 <= last; idx += 16 ){
+			__m128i c0 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( buffer + idx ) );
+			__m128i c1 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( buffer + idx + 1 ) );
+			zconf::uint32 mask = _mm_movemask_epi8( _mm_and_si128(
+				_mm_cmpeq_epi8( c0, v0 ), _mm_cmpeq_epi8( c1, v1 ) ) );
+			while( mask ){
+				zconf::int64 cidx = idx + lowbit( mask );
+				if( le32( buffer + cidx ) == sign ) return cidx;
+				mask &= mask - 1;
+			}
+		}
+#endif
+		// find the first byte and compare the whole word
+		while( idx <= last ){
+			const void *match = std::memchr( buffer + idx, b0, last - idx + 1 );
+			if( match == 0 ) return -1;
+			idx = reinterpret_cast<const zconf::byte*>( match ) - buffer;
+			if( le32( buffer + idx ) == sign ) return idx;
+			idx++;
+		}
+	}else{
+		zconf::int64 idx = last;
+#ifdef ZSCAN_SSE2
+		// match the first two bytes of 16 candidates at once
+		const __m128i v0 = _mm_set1_epi8( b0 ), v1 = _mm_set1_epi8( b1 );
+		for( ; idx >= 15; idx -= 16 ){
+			const zconf::byte *base = buffer + idx - 15;
+			__m128i c0 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( base ) );
+			__m128i c1 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( base + 1 ) );
+			zconf::uint32 mask = _mm_movemask_epi8( _mm_and_si128(
+				_mm_cmpeq_epi8( c0, v0 ), _mm_cmpeq_epi8( c1, v1 ) ) );
+			while( mask ){
+				zconf::uint32 bit = highbit( mask );
+				if( le32( base + bit ) == sign ) return idx - 15 + bit;
+				mask &= ~( 1u << bit );
+			}
+		}
+#endif
+		for( ; idx >= 0; idx-- ){
+			if( buffer[ idx ] == b0 && le32( buffer + idx ) == sign ) return idx;
 		}
 	}
+	// not found
+	return -1;
+}
+
+zstats ziparchive::stats( void ) const{
+#ifdef ZSTATS
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	return _core->_stats;
+#else
+	return zstats();
+#endif
 }
 
 const std::string &ziparchive::error( void ) const{
@@ -418,52 +1512,132 @@ const std::string &ziparchive::comment( void ) const{
 
 // get the full list of entries
 std::vector<std::string> ziparchive::entries( void ){
+	// the index changes while entries are written
+	std::lock_guard<std::mutex> lock( _core->_mutex );
 	std::vector<std::string> entries;
-	// copy from internal set to vector
-	std::set<file_info_32*, sort_by_offset>::iterator first  = _core->_entries_by_name.begin();
-	std::set<file_info_32*, sort_by_offset>::iterator last   = _core->_entries_by_name.end();
-	// copy the name of the entry
-	while ( first != last ) entries.push_back( ( *first++ )->_file_name );
+	entries.reserve( _core->_entries_by_name.size() );
+	// copy the name of the entries sorted by name
+	for( zconf::uint64 idx = 0; idx < _core->_entries_by_name.size(); idx++ ){
+		zconf::uint32 id = _core->_entries_by_name[ idx ];
+		entries.push_back( std::string( _core->_cdr.name( id ), _core->_cdr._name_length[ id ] ) );
+	}
 	// return the vector
 	return entries;
 }
 
+zconf::uint64 ziparchive::uncompressed_size( const std::string &name ) const{
+	std::lock_guard<std::mutex> lock( _core->_mutex );
+	zconf::int64 id = lookup( name.c_str(), name.length() );
+	// unknown entries have no size
+	if( id < 0 ){
+		return 0;
+	}
+	return _core->_cdr._uncompressed_size[ id ];
+}
+
 ziparchive &ziparchive::close( void ){
-	// close buffer
-	_core->_fstream.close();
+	// close the entries left open
+	while( !_core->_open_entries.empty() ) _core->_open_entries.front()->close();
+	// write the central directory if it changed
+	if( is_open() && _core->_writable ){
+		std::lock_guard<std::mutex> lock( _core->_mutex );
+		write_cdr();
+	}
+	// close source
+	_core->_source.close();
 	// return object
 	return *this;
 }
 
 bool ziparchive::is_open( void ) const{
-	return _core->_fstream.is_open();
+	return _core->_source.is_open();
 }
 
 zipentry::zipentry(){
 	// it shouldn't be used!!!
 }
 
-zipentry::zipentry( ziparchive::core &acore, file_info_32 &entry, zconf::uint32 flags ){
+zipentry::zipentry( ziparchive &archive ){
 	_core = new core;
 
 	// assign values
-	_core->_acore = &acore;
-	_core->_entry = &entry;
+	_core->_archive = &archive;
+	_core->_acore = archive._core;
+	_core->_id = 0; _core->_dos_date = _core->_crc = 0;
+	_core->_compressed_size = _core->_uncompressed_size = 0;
+}
 
-	if( _core->_entry->_compressed_size ){
-		// open stream
-		_core->_zstream.open( _core->_acore->_fstream,
-			_core->_entry->_compressed_size, _core->_entry->_uncompressed_size,
-			_core->_entry->_absolute_offset, flags | zstream::fzip );
-	}
+void zipentry::open( zconf::uint32 id, zconf::uint32 flags ){
+	_core->_id = id;
+
+	// the archive is locked, its register is copied for the accessors
+	const cdr_store &cdr = _core->_acore->_cdr;
+	_core->_name.assign( cdr.name( id ), cdr._name_length[ id ] );
+	_core->_comment.assign( cdr.comment( id ), cdr._comment_length[ id ] );
+	_core->_dos_date = cdr._dos_date[ id ]; _core->_crc = cdr._crc[ id ];
+	_core->_compressed_size = cdr._compressed_size[ id ]; _core->_uncompressed_size = cdr._uncompressed_size[ id ];
+	// stored entries skip zlib
+	zconf::uint32 method = cdr._compression_method[ id ] == 0 ? zstream::fraw : zstream::fzip;
+	// writers can't go further than the reserved space ( if any )
+	zconf::uint64 csize = cdr._compressed_size[ id ];
+	if( ( flags & zstream::fwio ) && csize == 0 ) csize = ZIP64MAX - cdr._absolute_offset[ id ];
+	// open stream ( mappings are inflated in place )
+	_core->_zstream.setalloc( _core->_acore->_zalloc, _core->_acore->_zfree, _core->_acore->_opaque );
+	_core->_zstream.open( _core->_acore->_source,
+		csize, cdr._uncompressed_size[ id ],
+		cdr._absolute_offset[ id ], flags | method );
+	// the data read is checked against the directory
+	if( flags & zstream::frio ) _core->_zstream.setcrc( cdr._crc[ id ] );
 }
 
 zipentry &zipentry::read( zconf::cbytep data, zconf::uint64 nbytes ){
-	_core->_zstream.read( data, nbytes );
+	_core->_zstream.read( data, nbytes ); return *this;
+}
+
+zipentry &zipentry::view( const zconf::byte *&data, zconf::uint64 nbytes ){
+	_core->_zstream.view( data, nbytes ); return *this;
+}
+
+zipentry &zipentry::setthreads( zconf::uint32 threads, zconf::uint64 bsize ){
+	_core->_zstream.setthreads( threads, bsize ); return *this;
+}
+
+zipentry &zipentry::setreadahead( zconf::uint32 depth ){
+	_core->_zstream.setreadahead( depth ); return *this;
+}
+
+zconf::uint32 zipentry::crc( void ) const{
+	return _core->_zstream.crc();
+}
+
+zstats zipentry::stats( void ) const{
+	return _core->_zstream.stats();
+}
+
+zipentry &zipentry::seekg( zconf::uint64 offset ){
+	_core->_zstream.seekg( offset ); return *this;
+}
+
+zindex &zipentry::index( void ){
+	return _core->_zstream.index();
+}
+
+bool zipentry::save_index( const char *path ) const{
+	return _core->_zstream.index().save( path, _core->_compressed_size,
+		_core->_uncompressed_size, _core->_crc );
+}
+
+bool zipentry::load_index( const char *path ){
+	return _core->_zstream.index().load( path, _core->_compressed_size,
+		_core->_uncompressed_size, _core->_crc );
+}
+
+zipentry &zipentry::copyto( int fd ){
+	_core->_zstream.copyto( fd ); return *this;
 }
 
 zipentry &zipentry::write( zconf::cbytep data, zconf::uint64 nbytes ){
-	_core->_zstream.write( data, nbytes );
+	_core->_zstream.write( data, nbytes ); return *this;
 }
 
 bool zipentry::eof( void ) const{
@@ -495,35 +1669,42 @@ zipentry::~zipentry(){
 }
 
 void zipentry::close(  void ){
+	bool writing = _core->_zstream.flags() & zstream::fwio;
 	_core->_zstream.close();
-	// remove entry from open list
-	_core->_acore->_open_entries.remove( this );
-	// delete object
-	delete this;
+	// move the entry to the idle list, it's reused by the next opening
+	std::unique_lock<std::mutex> lock( _core->_acore->_mutex );
+	std::list<zipentry *> &open_entries = _core->_acore->_open_entries;
+	std::list<zipentry *>::iterator position = std::find( open_entries.begin(), open_entries.end(), this );
+	// the archive counts the closed streams
+	ZSTAT( if( position != open_entries.end() ) _core->_acore->_stats.merge( _core->_zstream.stats() ); )
+	if( position != open_entries.end() ) _core->_acore->_idle_entries.splice( _core->_acore->_idle_entries.begin(), open_entries, position );
+	// complete the register
+	if( writing ) _core->_archive->finish( _core->_id, _core->_zstream );
+	lock.unlock();
 }
 
 bool zipentry::is_open( void ) const{
-	return ( _core->_entry != 0 && _core->_acore != 0 );
+	return _core->_zstream.is_open();
 }
 
 zip_tm zipentry::timestamp( void ) const{
-	return _core->_entry->_tmu_date;
+	return ziparchive::dosbin2timestamp( _core->_dos_date );
 }
 
 std::string zipentry::name( void ) const{
-	return _core->_entry->_file_name;
+	return _core->_name;
 }
 
 std::string zipentry::comment( void ) const{
-	return _core->_entry->_file_comment;
+	return _core->_comment;
 }
 
-zconf::uint32 zipentry::compressed_size( void ) const{
-	return _core->_entry->_compressed_size;
+zconf::uint64 zipentry::compressed_size( void ) const{
+	return _core->_compressed_size;
 }
 
-zconf::uint32 zipentry::uncompressed_size( void ) const{
-	return _core->_entry->_uncompressed_size;
+zconf::uint64 zipentry::uncompressed_size( void ) const{
+	return _core->_uncompressed_size;
 }
 
 /* CODE COMMENT FOOTER (1) >> READ LOCAL FILE HEADER: not necessary?
@@ -18,12 +18,13 @@
 #define ZIPARCHIVE_H_
 
 #include "zconf.h"
+#include "zsource.h"
 #include "zstream.h"
+#include "zarena.h"
 
 #include <vector>
 
 // special types
-typedef struct file_info_32;
 typedef struct zip_tm;
 class zipentry;
 
@@ -33,24 +34,41 @@ public:
 	// default constructor
 	ziparchive( void );
 	// constructor 2
-	ziparchive( const char *path );
+	ziparchive( const char *path, zconf::uint32 flags = 0 );
 	// destructor
 	virtual ~ziparchive( void );
 
 public:
 	// get entry from archive
 	zipentry *entry( const std::string &name,
-		zconf::uint32 size = 0, zconf::uint32 flags = zstream::frio );
+		zconf::uint64 size = 0, zconf::uint32 flags = zstream::frio );
+	// get entry from archive ( name view, no allocations on lookup )
+	zipentry *entry( const char *name, zconf::uint64 length,
+		zconf::uint64 size, zconf::uint32 flags );
 	// set zip comment
-	ziparchive &set_comment( const std::string &comment ) const;
+	ziparchive &set_comment( const std::string &comment );
 	// get zip comment
 	const std::string &comment( void ) const;
 	// get the full list of entries
 	std::vector<std::string> entries( void );
+	// read a whole entry ( small entries take one i/o & one inflate call )
+	bool read( const std::string &name, std::string &data );
+	// get the uncompressed size of an entry without opening it
+	zconf::uint64 uncompressed_size( const std::string &name ) const;
 	// get error string
 	const std::string &error( void ) const;
-	// open from iostream
-	ziparchive &open( const char *path );
+	// counters of the closed entries & latencies of the lookups and openings ( empty without ZSTATS )
+	zstats stats( void ) const;
+	// open from iostream or memory mapping
+	ziparchive &open( const char *path, zconf::uint32 flags = 0 );
+	// remove an entry, its local space is reused by the next entries
+	ziparchive &remove( const std::string &name );
+	// copy an entry from another archive as it is ( no recompression, the error is empty if it's copied )
+	ziparchive &copy( ziparchive &from, const std::string &name );
+	// allocate the zlib states of the next entries with zalloc & zfree ( see zarena )
+	ziparchive &setalloc( alloc_func zalloc, free_func zfree, voidpf opaque );
+	// write the central directory if it changed
+	ziparchive &flush( void );
 	// defrag archive
 	ziparchive &defrag( void );
 	// close archive if necessary
@@ -64,15 +82,63 @@ public:
 
 private:
 	// find signature from the get cursor backwards
-	zconf::uint32 find_signature( zconf::uint32 sign, zconf::uint32 sindex, bool forewards = true );
+	zconf::uint64 find_signature( zconf::uint32 sign, zconf::uint64 sindex, bool forewards = true );
+	// find the end of central directory record with a single tail read
+	const zconf::byte *find_ecd( void );
+	// find signature inside a memory buffer ( -1 if it isn't there )
+	static zconf::int64 scan_signature( const zconf::byte *buffer, zconf::uint64 size,
+		zconf::uint32 sign, bool forewards = true );
 	// convert timestamp to binary
-	zconf::uint32 timestamp2dosbin( const zip_tm &timestamp );
+	static zconf::uint32 timestamp2dosbin( const zip_tm &timestamp );
 	// convert binary to timestamp
-	zip_tm dosbin2timestamp( zconf::uint32 bin );
-	// find a gap inside the local space
-	zconf::uint32 find_gap( zconf::uint32 size );
+	static zip_tm dosbin2timestamp( zconf::uint32 bin );
+	// take the best fitting gap of the local space ( 0 asks for the end of the local space )
+	zconf::uint64 find_gap( zconf::uint64 size );
+	// map the free extents of the local space
+	bool map_free( void );
+	// give back the local space between start & end
+	void release( zconf::uint64 start, zconf::uint64 end );
+	// forget a free extent
+	void unmap_free( zconf::uint64 offset, zconf::uint64 size );
+	// current time in DOS format
+	static zconf::uint32 now( void );
+	// complete the register of a written entry and write its data descriptor
+	bool finish( zconf::uint32 id, const zstream &stream );
+	// write the central directory & ending records
+	bool write_cdr( void );
+	// read zip64 end of central directory record
+	bool read_ecd64( void );
 	// read central directory records
 	void read_cdr( void );
+	// resolve the data offset from the local file header
+	bool locate( zconf::uint32 id );
+	// read a local file header: data offset & located state ( no lock needed )
+	bool read_local( zconf::uint64 offset, zconf::uint16 flag, zconf::uint64 &absolute, zconf::uint8 &state ) const;
+	// resolve the data offsets of every entry
+	bool locate_all( void );
+	// end of the local space of an entry ( the data descriptor is read )
+	zconf::uint64 local_end( zconf::uint32 id );
+	// take an idle entry & open it
+	zipentry *take_entry( zconf::uint32 id, zconf::uint32 flags );
+	// find the identifier of an entry ( -1 if it isn't there )
+	zconf::int64 lookup( const char *name, zconf::uint64 length ) const;
+	// add a register to the index
+	void insert( zconf::uint32 id );
+	// remove a register from the index
+	void remove( zconf::uint32 id );
+	// add an identifier to the hash table ( false if the name is taken )
+	bool hash_insert( zconf::uint32 id );
+	// rebuild the hash table
+	void rehash( zconf::uint64 capacity );
+	// delete all the registers
+	void clear( void );
+	// get a pointer to size bytes at offset
+	zconf::bytep fetch( zconf::uint64 offset, zconf::uint64 size );
+
+public:
+	// class flags
+	static const zconf::uint32 fmap    = 0x01; // memory mapped ( read only )
+	static const zconf::uint32 fcreate = 0x02; // create the archive if it doesn't exist
 
 public:
 	// friend classes
@@ -103,9 +169,9 @@ public:
 	// comment of the entry
 	std::string comment( void ) const;
 	// get compressed size
-	zconf::uint32 compressed_size( void ) const;
+	zconf::uint64 compressed_size( void ) const;
 	// get uncompressed size
-	zconf::uint32 uncompressed_size( void ) const;
+	zconf::uint64 uncompressed_size( void ) const;
 
 	// ZSTREAM INTERFACE
 
@@ -123,13 +189,35 @@ public:
 	const std::string &error( void ) const;
 	// read n bytes and allocate them on data
 	zipentry &read( zconf::cbytep data, zconf::uint64 nbytes );
+	// borrow up to n bytes of the internal buffer, valid until the next call
+	zipentry &view( const zconf::byte *&data, zconf::uint64 nbytes = ZCOBSIZE );
+	// compress by blocks on n threads ( before writing )
+	zipentry &setthreads( zconf::uint32 threads, zconf::uint64 bsize = ZCPBSIZE );
+	// read the compressed data ahead on another thread, depth chunks ( before reading )
+	zipentry &setreadahead( zconf::uint32 depth = ZCAHEAD );
+	// crc-32 of the uncompressed data treated
+	zconf::uint32 crc( void ) const;
+	// counters of the entry stream ( empty without ZSTATS )
+	zstats stats( void ) const;
+	// go to an uncompressed offset
+	zipentry &seekg( zconf::uint64 offset );
+	// access points of the entry
+	zindex &index( void );
+	// save the access points of the entry to a sidecar file
+	bool save_index( const char *path ) const;
+	// load the access points of the entry from a sidecar file
+	bool load_index( const char *path );
+	// copy the rest of the entry to the cursor of fd ( stored entries kernel to kernel )
+	zipentry &copyto( int fd );
 	// write n bytes on data
 	zipentry &write( zconf::cbytep data, zconf::uint64 nbytes );
 
 private:
 	// private constructors
-	zipentry( ziparchive::core &acore, file_info_32 &entry, zconf::uint32 flags );
+	zipentry( ziparchive &archive );
 	zipentry();
+	// open the stream of a register
+	void open( zconf::uint32 id, zconf::uint32 flags );
 
 private:
 	// class core structure declaration
@@ -0,0 +1,98 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "zpool.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef struct zpool::core{
+	// worker threads
+	std::vector<std::thread> _threads;
+	// pending jobs
+	std::deque<std::function<void()> > _jobs;
+	// jobs queued or running
+	zconf::uint64 _active;
+	// the pool is being destroyed
+	bool _stop;
+	// queue lock & signals
+	std::mutex _mutex;
+	std::condition_variable _ready, _done;
+};
+
+zpool::zpool( zconf::uint32 threads ){
+	_core = new core;
+	// set values to zero
+	_core->_active = 0; _core->_stop = false;
+	// at least one thread
+	if( threads == 0 ) threads = 1;
+	for( zconf::uint32 i = 0; i < threads; i++ ){
+		_core->_threads.push_back( std::thread( &zpool::run, this ) );
+	}
+}
+
+zpool::~zpool( void ){
+	{
+		std::lock_guard<std::mutex> lock( _core->_mutex );
+		_core->_stop = true;
+	}
+	_core->_ready.notify_all();
+	// wait for the threads
+	for( zconf::uint32 i = 0; i < _core->_threads.size(); i++ ){
+		_core->_threads[i].join();
+	}
+	delete _core;
+}
+
+zpool &zpool::push( const std::function<void()> &job ){
+	{
+		std::lock_guard<std::mutex> lock( _core->_mutex );
+		_core->_jobs.push_back( job ); _core->_active++;
+	}
+	_core->_ready.notify_one();
+	// return reference
+	return *this;
+}
+
+zpool &zpool::wait( void ){
+	std::unique_lock<std::mutex> lock( _core->_mutex );
+	while( _core->_active > 0 ) _core->_done.wait( lock );
+	// return reference
+	return *this;
+}
+
+zconf::uint32 zpool::size( void ) const{
+	return _core->_threads.size();
+}
+
+void zpool::run( void ){
+	std::unique_lock<std::mutex> lock( _core->_mutex );
+	for(;;){
+		// sleep until there's something to do
+		while( _core->_jobs.empty() && !_core->_stop ) _core->_ready.wait( lock );
+		if( _core->_jobs.empty() ) return;
+		// run the job out of the lock
+		std::function<void()> job = _core->_jobs.front();
+		_core->_jobs.pop_front();
+		lock.unlock(); job(); lock.lock();
+		// the last one wakes up the waiters
+		if( --_core->_active == 0 ) _core->_done.notify_all();
+	}
+}
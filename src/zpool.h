@@ -0,0 +1,57 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ZPOOL_H_
+#define ZPOOL_H_
+
+#include "zconf.h"
+
+#include <functional>
+
+/**
+ * zpool keeps a fixed set of threads waiting for jobs, so the work
+ * of a stream can be split without creating threads on every call
+ */
+class zpool{
+
+public:
+	// constructor
+	zpool( zconf::uint32 threads );
+	// destructor
+	virtual ~zpool( void );
+
+public:
+	// queue a job
+	zpool &push( const std::function<void()> &job );
+	// wait until every queued job is done
+	zpool &wait( void );
+	// number of threads
+	zconf::uint32 size( void ) const;
+
+private:
+	// thread loop
+	void run( void );
+
+private:
+	// class core structure declaration
+	typedef struct core;
+	// internal core structure
+	core *_core;
+
+};
+
+#endif //ZPOOL_H_
@@ -0,0 +1,400 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "zsource.h"
+
+#include <atomic>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// raise the size to end, other threads may be growing it too
+static inline void grow( std::atomic<zconf::uint64> &size, zconf::uint64 end ){
+	zconf::uint64 current = size.load();
+	while( end > current && !size.compare_exchange_weak( current, end ) );
+}
+
+typedef struct zsource::core{
+#ifdef _WIN32
+	// file handle
+	HANDLE _file;
+#else
+	// file descriptor
+	int _fd;
+#endif
+	// file mapping ( fmap )
+	zconf::bytep _map;
+	// file size ( written & read from many threads )
+	std::atomic<zconf::uint64> _size;
+	// active flags
+	zconf::uint32 _flags;
+	// error string
+	std::string _error;
+};
+
+zsource::zsource( void ){
+	_core = new core;
+	// set values to zero
+#ifdef _WIN32
+	_core->_file = INVALID_HANDLE_VALUE;
+#else
+	_core->_fd = -1;
+#endif
+	_core->_map = 0; _core->_size = 0; _core->_flags = 0;
+}
+
+zsource::zsource( const char *path, zconf::uint32 flags ){
+	_core = new core;
+	// set values to zero
+#ifdef _WIN32
+	_core->_file = INVALID_HANDLE_VALUE;
+#else
+	_core->_fd = -1;
+#endif
+	_core->_map = 0; _core->_size = 0; _core->_flags = 0;
+	// open the file
+	open( path, flags );
+}
+
+zsource::~zsource( void ){
+	close(); delete _core;
+}
+
+zsource &zsource::open( const char *path, zconf::uint32 flags ){
+	if( is_open() ){
+		_core->_error = "zsource: is already open";
+		return *this;
+	}
+	_core->_flags = flags;
+#ifdef _WIN32
+	// open the file
+	DWORD access = ( flags & fwio ) && !( flags & fmap ) ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+	DWORD creation = ( flags & fwio ) && !( flags & fmap ) && ( flags & fnew ) ? OPEN_ALWAYS : OPEN_EXISTING;
+	_core->_file = CreateFileA( path, access, FILE_SHARE_READ, 0, creation, FILE_ATTRIBUTE_NORMAL, 0 );
+	if( _core->_file == INVALID_HANDLE_VALUE ){
+		_core->_error = "zsource: the file couldn't be open";
+		return *this;
+	}
+	LARGE_INTEGER size;
+	if( GetFileSizeEx( _core->_file, &size ) ) _core->_size = size.QuadPart;
+	// map the file
+	if( flags & fmap ){
+		HANDLE mapping = 0;
+		if( _core->_size > 0 ) mapping = CreateFileMappingA( _core->_file, 0, PAGE_READONLY, 0, 0, 0 );
+		if( mapping != 0 ){
+			_core->_map = reinterpret_cast<zconf::bytep>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+			// the view keeps the mapping alive
+			CloseHandle( mapping );
+		}
+		if( _core->_map == 0 ){
+			_core->_error = "zsource: the file couldn't be mapped";
+			close();
+		}
+	}
+#else
+	// open the file
+	int oflags = ( flags & fwio ) && !( flags & fmap ) ? O_RDWR : O_RDONLY;
+	if( ( oflags & O_RDWR ) && ( flags & fnew ) ) oflags |= O_CREAT;
+	_core->_fd = ::open( path, oflags, 0644 );
+	if( _core->_fd < 0 ){
+		_core->_error = "zsource: the file couldn't be open";
+		return *this;
+	}
+	struct stat st;
+	if( fstat( _core->_fd, &st ) == 0 ) _core->_size = st.st_size;
+	// map the file
+	if( flags & fmap ){
+		void *addr = MAP_FAILED;
+		if( _core->_size > 0 ) addr = mmap( 0, _core->_size, PROT_READ, MAP_SHARED, _core->_fd, 0 );
+		if( addr != MAP_FAILED ){
+			_core->_map = reinterpret_cast<zconf::bytep>( addr );
+		}else{
+			_core->_error = "zsource: the file couldn't be mapped";
+			close();
+		}
+	}
+#endif
+	// return reference
+	return *this;
+}
+
+zsource &zsource::close( void ){
+	// release the mapping
+	if( _core->_map != 0 ){
+#ifdef _WIN32
+		UnmapViewOfFile( _core->_map );
+#else
+		munmap( _core->_map, _core->_size );
+#endif
+		_core->_map = 0;
+	}
+	// close the file
+#ifdef _WIN32
+	if( _core->_file != INVALID_HANDLE_VALUE ) CloseHandle( _core->_file );
+	_core->_file = INVALID_HANDLE_VALUE;
+#else
+	if( _core->_fd >= 0 ) ::close( _core->_fd );
+	_core->_fd = -1;
+#endif
+	_core->_size = 0;
+	// return reference
+	return *this;
+}
+
+bool zsource::is_open( void ) const{
+#ifdef _WIN32
+	return _core->_file != INVALID_HANDLE_VALUE;
+#else
+	return _core->_fd >= 0;
+#endif
+}
+
+bool zsource::is_mapped( void ) const{
+	return _core->_map != 0;
+}
+
+zconf::uint64 zsource::pread( zconf::bytep data, zconf::uint64 nbytes, zconf::uint64 offset ) const{
+	// check boundaries
+	zconf::uint64 size = _core->_size;
+	if( offset >= size ) return 0;
+	if( nbytes > size - offset ) nbytes = size - offset;
+	// mapped files are copied
+	if( _core->_map != 0 ){
+		std::memcpy( data, _core->_map + offset, nbytes );
+		return nbytes;
+	}
+	// read until it's done
+	zconf::uint64 done = 0;
+	while( done < nbytes ){
+#ifdef _WIN32
+		OVERLAPPED overlapped = { 0 };
+		overlapped.Offset     = static_cast<DWORD>( offset + done );
+		overlapped.OffsetHigh = static_cast<DWORD>( ( offset + done ) >> 32 );
+		DWORD chunk = nbytes - done > ( 1u << 30 ) ? ( 1u << 30 ) : static_cast<DWORD>( nbytes - done ), count = 0;
+		if( !ReadFile( _core->_file, data + done, chunk, &count, &overlapped ) || count == 0 ) break;
+#else
+		ssize_t count = ::pread( _core->_fd, data + done, nbytes - done, offset + done );
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) break;
+#endif
+		done += count;
+	}
+	return done;
+}
+
+zconf::uint64 zsource::pwrite( const zconf::byte *data, zconf::uint64 nbytes, zconf::uint64 offset ){
+	// mapped files are read only
+	if( _core->_map != 0 || !is_open() ) return 0;
+	// write until it's done
+	zconf::uint64 done = 0;
+	while( done < nbytes ){
+#ifdef _WIN32
+		OVERLAPPED overlapped = { 0 };
+		overlapped.Offset     = static_cast<DWORD>( offset + done );
+		overlapped.OffsetHigh = static_cast<DWORD>( ( offset + done ) >> 32 );
+		DWORD chunk = nbytes - done > ( 1u << 30 ) ? ( 1u << 30 ) : static_cast<DWORD>( nbytes - done ), count = 0;
+		if( !WriteFile( _core->_file, data + done, chunk, &count, &overlapped ) || count == 0 ) break;
+#else
+		ssize_t count = ::pwrite( _core->_fd, data + done, nbytes - done, offset + done );
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) break;
+#endif
+		done += count;
+	}
+	// grow the size
+	grow( _core->_size, offset + done );
+	return done;
+}
+
+zconf::uint64 zsource::copyto( int fd, zconf::uint64 nbytes, zconf::uint64 offset ) const{
+	// check boundaries
+	zconf::uint64 size = _core->_size;
+	if( offset >= size || !is_open() ) return 0;
+	if( nbytes > size - offset ) nbytes = size - offset;
+	zconf::uint64 done = 0;
+	// mapped files are written as they are
+	if( _core->_map != 0 ){
+		return writeto( fd, _core->_map + offset, nbytes );
+	}
+#ifdef __linux__
+	// kernel to kernel copies, each one goes on where the previous one failed
+	loff_t in = offset;
+	while( done < nbytes ){
+		ssize_t count = copy_file_range( _core->_fd, &in, fd, 0, nbytes - done, 0 );
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) break;
+		done += count;
+	}
+	off_t sin = offset + done;
+	while( done < nbytes ){
+		ssize_t count = sendfile( fd, _core->_fd, &sin, nbytes - done > 0x7ffff000 ? 0x7ffff000 : nbytes - done );
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) break;
+		done += count;
+	}
+	in = offset + done;
+	while( done < nbytes ){
+		// only pipes can be spliced
+		ssize_t count = splice( _core->_fd, &in, fd, 0, nbytes - done, SPLICE_F_MOVE );
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) break;
+		done += count;
+	}
+#endif
+	// copy through a buffer
+	if( done < nbytes ){
+		zconf::uint64 size = nbytes - done < ZCIBSIZE ? nbytes - done : ZCIBSIZE;
+		zconf::bytep buffer = new zconf::byte[ size ];
+		while( done < nbytes ){
+			zconf::uint64 count = pread( buffer, nbytes - done < size ? nbytes - done : size, offset + done );
+			if( count == 0 || writeto( fd, buffer, count ) != count ) break;
+			done += count;
+		}
+		delete[] buffer;
+	}
+	return done;
+}
+
+zconf::uint64 zsource::copyto( zsource &target, zconf::uint64 nbytes, zconf::uint64 offset, zconf::uint64 toffset ) const{
+	// check boundaries
+	zconf::uint64 size = _core->_size;
+	if( offset >= size || !is_open() || !target.is_open() || target.is_mapped() ) return 0;
+	if( nbytes > size - offset ) nbytes = size - offset;
+	zconf::uint64 done = 0;
+	// mapped files are written as they are
+	if( _core->_map != 0 ){
+		return target.pwrite( _core->_map + offset, nbytes, toffset );
+	}
+#ifdef __linux__
+	// kernel to kernel copies ( reflinks on some file systems )
+	loff_t in = offset, out = toffset;
+	while( done < nbytes ){
+		ssize_t count = copy_file_range( _core->_fd, &in, target._core->_fd, &out, nbytes - done, 0 );
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) break;
+		done += count;
+	}
+	grow( target._core->_size, toffset + done );
+#endif
+	// copy through a buffer
+	if( done < nbytes ){
+		zconf::uint64 size = nbytes - done < ZCMOVE ? nbytes - done : ZCMOVE;
+		zconf::bytep buffer = new zconf::byte[ size ];
+		while( done < nbytes ){
+			zconf::uint64 count = pread( buffer, nbytes - done < size ? nbytes - done : size, offset + done );
+			if( count == 0 || target.pwrite( buffer, count, toffset + done ) != count ) break;
+			done += count;
+		}
+		delete[] buffer;
+	}
+	return done;
+}
+
+zconf::uint64 zsource::move( zconf::uint64 to, zconf::uint64 from, zconf::uint64 nbytes ){
+	// mapped files are read only, data only moves backwards
+	zconf::uint64 size = _core->_size;
+	if( _core->_map != 0 || !is_open() || to > from || from >= size ) return 0;
+	if( nbytes > size - from ) nbytes = size - from;
+	if( to == from ) return nbytes;
+	zconf::uint64 done = 0, distance = from - to;
+#ifdef __linux__
+	// kernel to kernel copies can't overlap, far moves go by chunks of the distance
+	loff_t in = from, out = to;
+	while( distance >= ZCIBSIZE && done < nbytes ){
+		ssize_t count = copy_file_range( _core->_fd, &in, _core->_fd, &out,
+			nbytes - done < distance ? nbytes - done : distance, 0 );
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) break;
+		done += count;
+	}
+#endif
+	// copy through a buffer, going forwards never reads what was written
+	if( done < nbytes ){
+		zconf::uint64 size = nbytes - done < ZCMOVE ? nbytes - done : ZCMOVE;
+		zconf::bytep buffer = new zconf::byte[ size ];
+		while( done < nbytes ){
+			zconf::uint64 count = pread( buffer, nbytes - done < size ? nbytes - done : size, from + done );
+			if( count == 0 || pwrite( buffer, count, to + done ) != count ) break;
+			done += count;
+		}
+		delete[] buffer;
+	}
+	return done;
+}
+
+zconf::uint64 zsource::writeto( int fd, const zconf::byte *data, zconf::uint64 nbytes ){
+	// write until it's done
+	zconf::uint64 done = 0;
+	while( done < nbytes ){
+#ifdef _WIN32
+		unsigned int chunk = nbytes - done > ( 1u << 30 ) ? ( 1u << 30 ) : static_cast<unsigned int>( nbytes - done );
+		int count = _write( fd, data + done, chunk );
+		if( count <= 0 ) break;
+#else
+		ssize_t count = ::write( fd, data + done, nbytes - done );
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) break;
+#endif
+		done += count;
+	}
+	return done;
+}
+
+const zconf::byte *zsource::view( zconf::uint64 offset, zconf::uint64 nbytes ) const{
+	zconf::uint64 size = _core->_size;
+	if( _core->_map == 0 || offset > size || nbytes > size - offset ) return 0;
+	return _core->_map + offset;
+}
+
+zsource &zsource::truncate( zconf::uint64 size ){
+	if( _core->_map != 0 || !is_open() ){
+		_core->_error = "zsource: the file can not be truncated";
+		return *this;
+	}
+#ifdef _WIN32
+	LARGE_INTEGER position; position.QuadPart = size;
+	if( !SetFilePointerEx( _core->_file, position, 0, FILE_BEGIN ) || !SetEndOfFile( _core->_file ) ){
+#else
+	if( ftruncate( _core->_fd, size ) != 0 ){
+#endif
+		_core->_error = "zsource: the file can not be truncated";
+		return *this;
+	}
+	_core->_size = size;
+	// return reference
+	return *this;
+}
+
+zconf::uint64 zsource::size( void ) const{
+	return _core->_size;
+}
+
+const std::string &zsource::error( void ) const{
+	return _core->_error;
+}
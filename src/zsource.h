@@ -0,0 +1,85 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ZSOURCE_H_
+#define ZSOURCE_H_
+
+#include "zconf.h"
+
+/**
+ * zsource gives positional access to a file, through pread / pwrite
+ * on a shared descriptor or through a read only memory mapping, so
+ * there's no shared cursor and many readers can use the same source
+ * from different threads without any lock
+ */
+class zsource{
+
+public:
+	// default constructor
+	zsource( void );
+	// constructor 2
+	zsource( const char *path, zconf::uint32 flags = frio );
+	// destructor
+	virtual ~zsource( void );
+
+public:
+	// open file
+	zsource &open( const char *path, zconf::uint32 flags = frio );
+	// close file if necessary
+	zsource &close( void );
+	// tell us if the file is open
+	bool is_open( void ) const;
+	// tell us if the file is mapped
+	bool is_mapped( void ) const;
+
+public:
+	// read n bytes at offset, returns the bytes read
+	zconf::uint64 pread( zconf::bytep data, zconf::uint64 nbytes, zconf::uint64 offset ) const;
+	// write n bytes at offset, returns the bytes written
+	zconf::uint64 pwrite( const zconf::byte *data, zconf::uint64 nbytes, zconf::uint64 offset );
+	// copy n bytes at offset to the cursor of fd ( kernel to kernel if possible )
+	zconf::uint64 copyto( int fd, zconf::uint64 nbytes, zconf::uint64 offset ) const;
+	// copy n bytes at offset to another source at toffset ( kernel to kernel if possible )
+	zconf::uint64 copyto( zsource &target, zconf::uint64 nbytes, zconf::uint64 offset, zconf::uint64 toffset ) const;
+	// move n bytes from offset to a lower offset, returns the bytes moved
+	zconf::uint64 move( zconf::uint64 to, zconf::uint64 from, zconf::uint64 nbytes );
+	// write n bytes to the cursor of fd, returns the bytes written
+	static zconf::uint64 writeto( int fd, const zconf::byte *data, zconf::uint64 nbytes );
+	// pointer to n bytes at offset ( only if mapped and inside the file )
+	const zconf::byte *view( zconf::uint64 offset, zconf::uint64 nbytes ) const;
+	// set the file size
+	zsource &truncate( zconf::uint64 size );
+	// get the file size
+	zconf::uint64 size( void ) const;
+	// get error string
+	const std::string &error( void ) const;
+
+private:
+	// class core structure declaration
+	typedef struct core;
+	// internal core structure
+	core *_core;
+
+public:
+	// class flags
+	static const zconf::uint32 frio    = 0x01; // read
+	static const zconf::uint32 fwio    = 0x02; // write
+	static const zconf::uint32 fmap    = 0x04; // memory mapped ( read only )
+	static const zconf::uint32 fnew    = 0x08; // create the file if it doesn't exist ( with fwio )
+
+};
+
+#endif //ZSOURCE_H_
@@ -0,0 +1,80 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "zstats.h"
+
+zhistogram::zhistogram( void ) : _count( 0 ){
+	for( zconf::uint32 n = 0; n < ZSBUCKETS; n++ ) _buckets[n] = 0;
+}
+
+zhistogram &zhistogram::add( zconf::uint64 ns ){
+	// the bucket is the highest bit
+	zconf::uint32 n = 0;
+	while( ns > 1 && n + 1 < ZSBUCKETS ){
+		ns >>= 1; n++;
+	}
+	_buckets[n]++; _count++;
+	// return reference
+	return *this;
+}
+
+zhistogram &zhistogram::merge( const zhistogram &other ){
+	for( zconf::uint32 n = 0; n < ZSBUCKETS; n++ ) _buckets[n] += other._buckets[n];
+	_count += other._count;
+	// return reference
+	return *this;
+}
+
+zconf::uint64 zhistogram::count( void ) const{
+	return _count;
+}
+
+zconf::uint64 zhistogram::bucket( zconf::uint32 n ) const{
+	return n < ZSBUCKETS ? _buckets[n] : 0;
+}
+
+zconf::uint64 zhistogram::percentile( double fraction ) const{
+	if( _count == 0 ) return 0;
+	// first bucket reaching the fraction of the samples
+	zconf::uint64 want = static_cast<zconf::uint64>( fraction * _count ), seen = 0;
+	if( want == 0 ) want = 1;
+	for( zconf::uint32 n = 0; n < ZSBUCKETS; n++ ){
+		seen += _buckets[n];
+		if( seen >= want ) return 2ULL << n;
+	}
+	return 2ULL << ( ZSBUCKETS - 1 );
+}
+
+zstats::zstats( void ) : bytes_in( 0 ), bytes_out( 0 ), inflates( 0 ), deflates( 0 ),
+	zlib_ns( 0 ), io_ns( 0 ), seeks( 0 ), refills( 0 ), streams( 0 ){
+}
+
+zstats &zstats::merge( const zstats &other ){
+	bytes_in += other.bytes_in; bytes_out += other.bytes_out;
+	inflates += other.inflates; deflates += other.deflates;
+	zlib_ns  += other.zlib_ns;  io_ns     += other.io_ns;
+	seeks    += other.seeks;    refills   += other.refills;
+	streams  += other.streams;
+	lookup_ns.merge( other.lookup_ns ); open_ns.merge( other.open_ns );
+	// return reference
+	return *this;
+}
+
+zconf::uint64 zstats::now( void ){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
@@ -0,0 +1,93 @@
+/**
+* Copyright 2011 Victor Egea Hernando
+*
+* Zipstream is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, version 3 of the License.
+*
+* Zipstream is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with Zipstream.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ZSTATS_H_
+#define ZSTATS_H_
+
+#include "zconf.h"
+
+#include <chrono>
+
+/**
+ * zstats are the counters of a stream, or of every stream of an archive,
+ * plus the latencies of the archive lookups & entry openings; they're
+ * only collected when the library is built with ZSTATS, otherwise the
+ * counting code is compiled out and the snapshots are empty
+ * <br /><br />
+ * the time in zlib against the time in i/o tells if a slow extraction
+ * is cpu or i/o bound
+ */
+
+// buckets of a latency histogram, the last one takes everything above 2^39 ns ( ~9 minutes )
+#define ZSBUCKETS 40
+
+#ifdef ZSTATS
+	// the statement is only compiled with the counters
+	#define ZSTAT( statement ) statement
+#else
+	#define ZSTAT( statement )
+#endif
+
+// latency histogram, the bucket n counts the latencies of [ 2^n, 2^(n+1) ) nanoseconds
+class zhistogram{
+
+public:
+	// default constructor
+	zhistogram( void );
+
+public:
+	// count a latency
+	zhistogram &add( zconf::uint64 ns );
+	// add the counts of another histogram
+	zhistogram &merge( const zhistogram &other );
+	// number of latencies
+	zconf::uint64 count( void ) const;
+	// latencies of the bucket n
+	zconf::uint64 bucket( zconf::uint32 n ) const;
+	// upper bound of the latency of a fraction of the samples ( 0.5, 0.99 )
+	zconf::uint64 percentile( double fraction ) const;
+
+private:
+	// counts by bucket & total
+	zconf::uint64 _buckets[ ZSBUCKETS ];
+	zconf::uint64 _count;
+
+};
+
+// counters snapshot
+typedef struct zstats{
+	// compressed bytes read or written & uncompressed bytes inflated or deflated
+	zconf::uint64 bytes_in, bytes_out;
+	// calls to inflate & deflate ( a parallel block is one call )
+	zconf::uint64 inflates, deflates;
+	// nanoseconds in zlib & in i/o ( reading or writing the compressed data )
+	zconf::uint64 zlib_ns, io_ns;
+	// moves of the compressed offset ( access points & iostream cursors ) & input refills
+	zconf::uint64 seeks, refills;
+	// streams counted ( closed entries for an archive )
+	zconf::uint64 streams;
+	// latencies of the archive: name lookups & entry openings
+	zhistogram lookup_ns, open_ns;
+	// default constructor
+	zstats( void );
+	// add the counters of another snapshot
+	zstats &merge( const zstats &other );
+	// monotonic clock in nanoseconds
+	static zconf::uint64 now( void );
+} zstats;
+
+#endif //ZSTATS_H_
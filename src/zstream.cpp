@@ -15,8 +15,186 @@
 */
 
 #include "zstream.h"
+#include "zpool.h"
+#include "zahead.h"
+#include "zcrc.h"
+#include "zarena.h"
 
 #include <cstring>
+#include <vector>
+
+// deflate window, the dictionary of a block is the tail of the previous one
+#define ZWSIZE ( 1 << 15 )
+
+// block of a parallel deflate
+typedef struct zblock{
+	// uncompressed data, dictionary & compressed data
+	std::string _input, _dict, _output;
+	// crc-32 of the input
+	zconf::uint32 _crc;
+	// last block of the stream
+	bool _last;
+	// zlib result
+	zconf::int32 _ret;
+} zblock;
+
+// zlib allocation hooks ( Z_NULL for the heap )
+typedef struct zhooks{
+	alloc_func _zalloc;
+	free_func _zfree;
+	voidpf _opaque;
+} zhooks;
+
+// zlib states & buffers left by the closed streams of a thread, for its next streams
+typedef struct zcache{
+	// reset states & how they were initialized
+	std::vector<std::pair<zconf::int32, z_stream*> > _states;
+	// buffers & their sizes
+	std::vector<std::pair<zconf::uint64, zconf::bytep> > _buffers;
+	// the thread is over
+	~zcache( void );
+} zcache;
+
+// kind of zlib state: deflate or inflate, raw or zlib wrapped & level
+static inline zconf::int32 state_kind( bool deflating, bool raw, zconf::int32 level ){
+	return ( deflating ? 1 : 0 ) | ( raw ? 2 : 0 ) | ( deflating ? ( level + 1 ) << 2 : 0 );
+}
+
+// window bits of a kind of zlib state
+static inline zconf::int32 state_wbits( zconf::int32 kind ){
+	return kind & 2 ? -MAX_WBITS : MAX_WBITS;
+}
+
+// the z_stream itself comes from the same allocator as its state
+static z_stream *new_state( const zhooks &hooks ){
+	if( hooks._zalloc == Z_NULL ) return new z_stream;
+	return static_cast<z_stream*>( hooks._zalloc( hooks._opaque, 1, sizeof( z_stream ) ) );
+}
+
+static void end_state( zconf::int32 kind, const zhooks &hooks, z_stream *zs ){
+	if( zs->state != Z_NULL ){
+		if( kind & 1 ) deflateEnd( zs ); else inflateEnd( zs );
+	}
+	if( hooks._zalloc == Z_NULL ) delete zs;
+	else hooks._zfree( hooks._opaque, zs );
+}
+
+// streams closed while the thread ends don't use the cache
+static thread_local bool cache_over = false;
+
+zcache::~zcache( void ){
+	zhooks heap = { Z_NULL, Z_NULL, Z_NULL };
+	for( zconf::uint64 idx = 0; idx < _states.size(); idx++ ) end_state( _states[ idx ].first, heap, _states[ idx ].second );
+	for( zconf::uint64 idx = 0; idx < _buffers.size(); idx++ ) delete[] _buffers[ idx ].second;
+	cache_over = true;
+}
+
+static zcache *thread_cache( void ){
+	static thread_local zcache cache;
+	return cache_over ? 0 : &cache;
+}
+
+// arena states are kept by their arena, which outlives them
+static inline zarena *state_arena( const zhooks &hooks ){
+	return hooks._zalloc == zarena::zalloc ? static_cast<zarena*>( hooks._opaque ) : 0;
+}
+
+// get a zlib state of the given kind, reused if the thread ( heap states ) or the arena has one
+static z_stream *take_state( zconf::int32 kind, zconf::int32 level, const zhooks &hooks ){
+	zarena *arena = state_arena( hooks );
+	if( arena != 0 ){
+		z_stream *zs = static_cast<z_stream*>( arena->reuse( kind ) );
+		if( zs != 0 ) return zs;
+	}
+	zcache *cache = hooks._zalloc == Z_NULL ? thread_cache() : 0;
+	for( zconf::uint64 idx = cache != 0 ? cache->_states.size() : 0; idx-- > 0; ){
+		if( cache->_states[ idx ].first != kind ) continue;
+		z_stream *zs = cache->_states[ idx ].second;
+		cache->_states.erase( cache->_states.begin() + idx );
+		return zs;
+	}
+	z_stream *zs = new_state( hooks );
+	if( zs == 0 ) return 0;
+	zs->zalloc = hooks._zalloc; zs->zfree = hooks._zfree; zs->opaque = hooks._opaque;
+	zs->avail_in = 0; zs->next_in = Z_NULL;
+	zconf::int32 wbits = state_wbits( kind ), ret;
+	if( kind & 1 ) ret = deflateInit2( zs, level, Z_DEFLATED, wbits, 8, Z_DEFAULT_STRATEGY );
+	else ret = inflateInit2( zs, wbits );
+	if( ret != Z_OK ){
+		zs->state = Z_NULL; end_state( kind, hooks, zs ); return 0;
+	}
+	return zs;
+}
+
+// keep a zlib state for the next stream of the thread or of the arena
+static void give_state( zconf::int32 kind, const zhooks &hooks, z_stream *zs ){
+	if( zs == 0 ) return;
+	// other custom allocators keep the memory themselves, the thread cache may outlive them
+	zarena *arena = state_arena( hooks );
+	zcache *cache = hooks._zalloc == Z_NULL ? thread_cache() : 0;
+	// broken states & states over the limit are released
+	if( ( cache == 0 && arena == 0 ) || zs->state == Z_NULL || ( cache != 0 && cache->_states.size() >= ZCCACHE ) ||
+		( ( kind & 1 ) ? deflateReset( zs ) : inflateReset2( zs, state_wbits( kind ) ) ) != Z_OK ){
+		end_state( kind, hooks, zs ); return;
+	}
+	if( arena != 0 ){
+		if( !arena->keep( kind, zs ) ) end_state( kind, hooks, zs );
+	}else{
+		cache->_states.push_back( std::make_pair( kind, zs ) );
+	}
+}
+
+// get a buffer of size bytes at least, size becomes the real one
+static zconf::bytep take_buffer( zconf::uint64 &size ){
+	zcache *cache = thread_cache();
+	zconf::int64 best = -1;
+	for( zconf::uint64 idx = 0; cache != 0 && idx < cache->_buffers.size(); idx++ ){
+		zconf::uint64 found = cache->_buffers[ idx ].first;
+		if( found >= size && ( best < 0 || found < cache->_buffers[ best ].first ) ) best = idx;
+	}
+	if( best < 0 ) return new zconf::byte[ size ];
+	zconf::bytep buffer = cache->_buffers[ best ].second; size = cache->_buffers[ best ].first;
+	cache->_buffers.erase( cache->_buffers.begin() + best );
+	return buffer;
+}
+
+// keep a buffer for the next stream of the thread
+static void give_buffer( zconf::bytep buffer, zconf::uint64 size ){
+	if( buffer == 0 ) return;
+	zcache *cache = thread_cache();
+	if( cache == 0 || cache->_buffers.size() >= ZCCACHE ){
+		delete[] buffer; return;
+	}
+	cache->_buffers.push_back( std::make_pair( size, buffer ) );
+}
+
+// compress one block, ending on a byte boundary unless it's the last one
+static void deflate_block( zblock &block, zconf::int32 level, const zhooks &hooks ){
+	zconf::int32 kind = state_kind( true, true, level );
+	block._crc = zcrc::update( 0, block._input.data(), block._input.size() );
+	z_stream *state = take_state( kind, level, hooks );
+	block._ret = state != 0 ? Z_OK : Z_MEM_ERROR;
+	if( block._ret != Z_OK ) return;
+	z_stream &zs = *state;
+	// continue the previous block's window
+	if( !block._dict.empty() ){
+		deflateSetDictionary( &zs, reinterpret_cast<const Bytef*>( block._dict.data() ), block._dict.size() );
+	}
+	zs.avail_in = block._input.size();
+	zs.next_in  = reinterpret_cast<Bytef*>( const_cast<zconf::bytep>( block._input.data() ) );
+	// room for the whole block plus the flush markers
+	block._output.resize( deflateBound( &zs, block._input.size() ) + 16 );
+	zconf::uint64 have = 0;
+	do{
+		if( have == block._output.size() ) block._output.resize( have * 2 );
+		zs.avail_out = block._output.size() - have;
+		zs.next_out  = reinterpret_cast<Bytef*>( &block._output[ have ] );
+		block._ret = deflate( &zs, block._last ? Z_FINISH : Z_SYNC_FLUSH );
+		have = block._output.size() - zs.avail_out;
+	}while( block._ret != Z_STREAM_ERROR && zs.avail_out == 0 );
+	block._output.resize( have );
+	give_state( kind, hooks, state );
+}
 
 typedef struct zstream::core {
 	// number of bytes read in the last operation
@@ -24,12 +202,14 @@ typedef struct zstream::core {
 	zconf::uint64 _gcount, _tcount, _izoffset, _zoffset;
 	// zstream buffers
 	zconf::bytep _obuffer, _ibuffer;
-	// zstream buffer size
-	zconf::uint64 _ozsize, _izsize;
+	// zstream buffer size & the largest ones asked by setbs
+	zconf::uint64 _ozsize, _izsize, _obs, _ibs;
 	// remaining data offset
 	zconf::uint64 _roffset, _rndata;
 	// iostream class pointer
 	std::iostream *_ios;
+	// positional source pointer
+	zsource *_src;
 	// active flags
 	zconf::uint32 _flags;
 	// size of compressed data
@@ -40,47 +220,107 @@ typedef struct zstream::core {
 	zconf::bytep _data;
 	// error string
 	std::string _error;
-	// zlib z_stream
-	z_stream _zstream;
+	// zlib z_stream ( stored data points to an empty one )
+	z_stream *_zstream, _zstored;
+	// how the zlib state was initialized & the allocator it uses
+	zconf::int32 _kind;
+	zhooks _hooks;
+	// compression level
+	zconf::int32 _level;
+	// crc-32 of the uncompressed data, the expected one & if it's checked
+	zconf::uint32 _crc, _ecrc;
+	bool _verify;
+	// parallel deflate: threads, block size & pool
+	zconf::uint32 _threads;
+	zconf::uint64 _bsize;
+	zpool *_pool;
+	// read ahead: chunks ahead & reader
+	zconf::uint32 _depth;
+	zahead *_ahead;
+	// parallel deflate: blocks, full blocks & window of the last block
+	std::vector<zblock> _blocks;
+	zconf::uint64 _nblocks;
+	std::string _dict;
+	// access points, last inflated window & bytes inflated
+	zindex _index;
+	std::string _window;
+	zconf::uint64 _inflated;
+#ifdef ZSTATS
+	// counters since the opening
+	zstats _stats;
+#endif
 };
 
 zstream::zstream( void ){
 	// init core structure
 	_core = new core;
 	// set values to zero
-	_core->_flags = 0; _core->_data = 0; _core->_ios = 0;
+	_core->_flags = 0; _core->_data = 0; _core->_ios = 0; _core->_src = 0;
+	_core->_ibuffer = _core->_obuffer = 0;
+	_core->_threads = 0; _core->_bsize = ZCPBSIZE; _core->_pool = 0;
+	_core->_depth = 0; _core->_ahead = 0;
+	_core->_obs = ZCOBSIZE; _core->_ibs = ZCIBSIZE; _core->_zstream = 0;
+	_core->_hooks._zalloc = Z_NULL; _core->_hooks._zfree = Z_NULL; _core->_hooks._opaque = Z_NULL;
 }
 
 zstream::~zstream( void ){
 	close(); delete _core;
 }
 
-zstream::zstream( zconf::bytep data, zconf::uint32 csize, zconf::uint32 usize,
+zstream::zstream( zconf::bytep data, zconf::uint64 csize, zconf::uint64 usize,
 		zconf::uint32 flags, zconf::int32 level ){
 	// init core structure
 	_core = new core;
 	// set values to zero
-	_core->_flags = 0; _core->_data = 0; _core->_ios = 0;
+	_core->_flags = 0; _core->_data = 0; _core->_ios = 0; _core->_src = 0;
+	_core->_ibuffer = _core->_obuffer = 0;
+	_core->_threads = 0; _core->_bsize = ZCPBSIZE; _core->_pool = 0;
+	_core->_depth = 0; _core->_ahead = 0;
+	_core->_obs = ZCOBSIZE; _core->_ibs = ZCIBSIZE; _core->_zstream = 0;
+	_core->_hooks._zalloc = Z_NULL; _core->_hooks._zfree = Z_NULL; _core->_hooks._opaque = Z_NULL;
+
+	// open buffer
+	open( data, csize, usize, flags, level );
+}
+
+zstream::zstream( std::iostream &ios, zconf::uint64 csize, zconf::uint64 usize,
+		zconf::uint64 offset, zconf::uint32 flags, zconf::int32 level ){
+	// init core structure
+	_core = new core;
+	// set values to zero
+	_core->_flags = 0; _core->_data = 0; _core->_ios = 0; _core->_src = 0;
+	_core->_ibuffer = _core->_obuffer = 0;
+	_core->_threads = 0; _core->_bsize = ZCPBSIZE; _core->_pool = 0;
+	_core->_depth = 0; _core->_ahead = 0;
+	_core->_obs = ZCOBSIZE; _core->_ibs = ZCIBSIZE; _core->_zstream = 0;
+	_core->_hooks._zalloc = Z_NULL; _core->_hooks._zfree = Z_NULL; _core->_hooks._opaque = Z_NULL;
 
 	// open buffer
-	open( data, csize, usize, flags );
+	open( ios, csize, usize, offset, flags, level );
 }
 
-zstream::zstream( std::iostream &ios, zconf::uint32 csize, zconf::uint32 usize,
+zstream::zstream( zsource &src, zconf::uint64 csize, zconf::uint64 usize,
 		zconf::uint64 offset, zconf::uint32 flags, zconf::int32 level ){
 	// init core structure
 	_core = new core;
 	// set values to zero
-	_core->_flags = 0; _core->_data = 0; _core->_ios = 0;
+	_core->_flags = 0; _core->_data = 0; _core->_ios = 0; _core->_src = 0;
+	_core->_ibuffer = _core->_obuffer = 0;
+	_core->_threads = 0; _core->_bsize = ZCPBSIZE; _core->_pool = 0;
+	_core->_depth = 0; _core->_ahead = 0;
+	_core->_obs = ZCOBSIZE; _core->_ibs = ZCIBSIZE; _core->_zstream = 0;
+	_core->_hooks._zalloc = Z_NULL; _core->_hooks._zfree = Z_NULL; _core->_hooks._opaque = Z_NULL;
 
 	// open buffer
-	open( ios, csize, usize, offset, flags );
+	open( src, csize, usize, offset, flags, level );
 }
 
 // initialize opening
 void zstream::inits( zconf::int32 level ){
+	_core->_error.clear();
+	ZSTAT( _core->_stats = zstats(); _core->_stats.streams = 1; )
 	// check input sources
-	if( _core->_ios != 0 || _core->_data != 0 ){
+	if( is_open() ){
 		_core->_error = "zstream: is already open";
 		 _core->_flags |= ferr;
 	}else{
@@ -97,74 +337,54 @@ void zstream::inits( zconf::int32 level ){
 		}
 	}
 
-	// init buffers to zero
-	_core->_obuffer = 0; _core->_ozsize = ZCOBSIZE;
-	_core->_ibuffer = 0; _core->_izsize = ZCIBSIZE;
+	// buffers fit the stream, setbs sizes are the largest ones
+	_core->_obuffer = 0; _core->_ozsize = _core->_obs;
+	_core->_ibuffer = 0; _core->_izsize = _core->_ibs;
+	zconf::uint64 bound = _core->_flags & frio ? _core->_usize : _core->_csize;
+	if( bound > 0 && bound < _core->_ozsize ) _core->_ozsize = bound > ZCMINBS ? bound : ZCMINBS;
+	if( _core->_csize > 0 && _core->_csize < _core->_izsize ) _core->_izsize = _core->_csize > ZCMINBS ? _core->_csize : ZCMINBS;
 
-	// allocate zstream state
-	_core->_zstream.zalloc = Z_NULL;
-	_core->_zstream.zfree = Z_NULL;
-	_core->_zstream.opaque = Z_NULL;
-
-	// prepare zstream
-	if( _core->_flags & frio ){
-		// allocate inflate state
-		_core->_zstream.avail_in = 0;
-		_core->_zstream.next_in = Z_NULL;
-		_core->_zstream.avail_out = ((zconf::uint32)(-1));
-
-		if( _core->_flags & fzip ){
-			// init inflate
-			if ( inflateInit2( &_core->_zstream, -MAX_WBITS ) != Z_OK ){
-				_core->_error = "zstream: zlib error";
-				_core->_flags |= ferr;
-			}
-		}else{
-			// init inflate
-			if ( inflateInit( &_core->_zstream ) != Z_OK ){
-				_core->_error = "zstream: zlib error";
-				_core->_flags |= ferr;
-			}
-		}
-	}else{
-		if( _core->_flags & fzip ){
-			// allocate deflate state
-			if ( deflateInit2( &_core->_zstream, level, Z_DEFLATED,
-				-MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK ){
-				_core->_error = "zstream: zlib error";
-				_core->_flags |= ferr;
-			}
-		}else{
-			// allocate deflate state
-			if ( deflateInit( &_core->_zstream, level ) != Z_OK ){
-				_core->_error = "zstream: zlib error";
-				 _core->_flags |= ferr;
-			}
+	// prepare zstream ( stored data skips zlib )
+	std::memset( &_core->_zstored, 0, sizeof( z_stream ) );
+	_core->_zstream = &_core->_zstored;
+	if( !( _core->_flags & fraw ) && !( _core->_flags & ferr ) ){
+		// zlib states are reused through the thread
+		_core->_kind = state_kind( _core->_flags & fwio, _core->_flags & fzip, level );
+		_core->_zstream = take_state( _core->_kind, level, _core->_hooks );
+		if( _core->_zstream == 0 ){
+			_core->_zstream = &_core->_zstored;
+			_core->_error = "zstream: zlib error";
+			_core->_flags |= ferr;
 		}
+		_core->_zstream->avail_in = 0;
+		_core->_zstream->next_in = Z_NULL;
+		_core->_zstream->avail_out = ((zconf::uint32)(-1));
 	}
 	// create buffers
-	_core->_ibuffer = new zconf::byte[ _core->_izsize ];
-	_core->_obuffer = new zconf::byte[ _core->_ozsize ];
+	_core->_obuffer = take_buffer( _core->_ozsize );
 
 	// set offsets and other counters
 	_core->_roffset = _core->_rndata = 0;
+	_core->_level = level; _core->_crc = 0; _core->_verify = false;
+	_core->_nblocks = 0; _core->_dict.clear();
+	_core->_index.clear(); _core->_window.clear(); _core->_inflated = 0;
 	// bytes treated
 	_core->_gcount = _core->_tcount = 0;
 }
 
-zstream &zstream::open( zconf::bytep data, zconf::uint32 csize, zconf::uint32 usize,
+zstream &zstream::open( zconf::bytep data, zconf::uint64 csize, zconf::uint64 usize,
 		zconf::uint32 flags, zconf::int32 level ){
 	// set values
 	_core->_csize = csize; _core->_usize = usize;
 	_core->_izoffset = _core->_zoffset = 0;
 	_core->_flags = flags;
-	// check opening
+	// check opening ( memory is inflated in place )
 	inits( level ); _core->_data = data;
 	// return reference
 	return *this;
 }
 
-zstream &zstream::open( std::iostream &ios, zconf::uint32 csize, zconf::uint32 usize,
+zstream &zstream::open( std::iostream &ios, zconf::uint64 csize, zconf::uint64 usize,
 		zconf::uint64 offset, zconf::uint32 flags, zconf::int32 level ){
 	// set values
 	_core->_csize = csize; _core->_usize = usize;
@@ -172,34 +392,60 @@ zstream &zstream::open( std::iostream &ios, zconf::uint32 csize, zconf::uint32 u
 	_core->_flags = flags;
 	// check opening
 	inits( level ); _core->_ios = &ios;
+	// create input buffer
+	_core->_ibuffer = take_buffer( _core->_izsize );
+	// return reference
+	return *this;
+}
+
+zstream &zstream::open( zsource &src, zconf::uint64 csize, zconf::uint64 usize,
+		zconf::uint64 offset, zconf::uint32 flags, zconf::int32 level ){
+	// set values
+	_core->_csize = csize; _core->_usize = usize;
+	_core->_izoffset = _core->_zoffset = offset;
+	_core->_flags = flags;
+	// check opening
+	inits( level ); _core->_src = &src;
+	// the compressed data must be inside the source
+	if( ( flags & frio ) && !( _core->_flags & ferr ) && ( offset > src.size() || csize > src.size() - offset ) ){
+		_core->_error = "zstream: the compressed data is out of the source bounds";
+		_core->_flags |= ferr;
+	}
+	// create input buffer ( mapped sources are inflated in place )
+	if( !src.is_mapped() ) _core->_ibuffer = take_buffer( _core->_izsize );
 	// return reference
 	return *this;
 }
 
 zstream &zstream::close( void ){
+	// check if it's open
+	if( !is_open() ) return *this;
 	// end zstream states
-	if( _core->_flags & fwio ){
-		flush();
-		deflateEnd( &_core->_zstream );
-	}else{
-		inflateEnd( &_core->_zstream );
-	}
-	// delete allocated buffers
-	if( _core->_ibuffer != 0 && _core->_ios != 0 ){
-		delete _core->_ibuffer;
-		_core->_ibuffer = 0;
+	if( ( _core->_flags & fwio ) && !( _core->_flags & fraw ) ) flush();
+	// the zlib state is kept for the next stream of the thread
+	if( _core->_zstream != &_core->_zstored ) give_state( _core->_kind, _core->_hooks, _core->_zstream );
+	_core->_zstream = 0;
+	// stop the threads
+	if( _core->_pool != 0 ){
+		delete _core->_pool; _core->_pool = 0;
+		_core->_blocks.clear();
 	}
-	if( _core->_obuffer != 0 ){
-		// delete allocated buffers
-		delete _core->_obuffer;
-		_core->_obuffer = 0;
+	if( _core->_ahead != 0 ){
+		delete _core->_ahead; _core->_ahead = 0;
 	}
+	// keep the buffers too
+	give_buffer( _core->_ibuffer, _core->_izsize );
+	give_buffer( _core->_obuffer, _core->_ozsize );
 	// reset pointers
-	_core->_data = 0; _core->_ios = 0;
+	_core->_ibuffer = _core->_obuffer = 0;
+	_core->_threads = 0; _core->_bsize = ZCPBSIZE; _core->_pool = 0; _core->_depth = 0;
+	_core->_data = 0; _core->_ios = 0; _core->_src = 0;
+	// return reference
+	return *this;
 }
 
 bool zstream::is_open( void ) const{
-	return ( _core->_ios != 0 || _core->_data != 0 );
+	return ( _core->_ios != 0 || _core->_data != 0 || _core->_src != 0 );
 }
 
 zconf::uint64 zstream::gcount( void ) const{
@@ -230,6 +476,7 @@ void zstream::seekoffset( void ){
 	if( _core->_ios != 0 ){
 		// seek file
 		if( _core->_ios != 0 ){
+			ZSTAT( _core->_stats.seeks++; )
 			if( _core->_flags & fwio ){
 				// PUT POINTER
 				_core->_ios->seekp( _core->_zoffset, std::ios::beg );
@@ -257,21 +504,8 @@ zstream &zstream::read( zconf::cbytep data, zconf::uint64 nbytes ){
 	// reset _core->_gcount
 	_core->_gcount = 0;
 
-	// set EOF
-	if( _core->_tcount >= _core->_usize ) _core->_flags = feof;
-
-	// check errors
-	if( _core->_ios == 0 && _core->_data == 0 ) {
-		return *this;
-	}else if( _core->_flags & ( feof | ferr ) ){
-		return *this;
-	}
-
-	// check mode
-	if( _core->_flags & fwio ){
-		_core->_error = "zstream: is set to read into the buffer";
-		_core->_flags |= ferr; return *this;
-	}
+	// check errors and mode
+	if( !readable() ) return *this;
 
 	// copy remaining data
 	if( _core->_rndata ){
@@ -297,96 +531,165 @@ zstream &zstream::read( zconf::cbytep data, zconf::uint64 nbytes ){
 		}
 	}
 
-	// go to the actual offset ( for multithreading over the same iostream )
+	// go to the actual offset ( the iostream cursor may be shared by many streams )
 	seekoffset(); if( _core->_flags & ferr ) return *this;
 
 	// inflate stream
 	for(;;){
-		zconf::int32 flush = Z_NO_FLUSH;
-		// check if there's remaining data to inflate in the zstream
-		if( _core->_zstream.avail_out > 0 ){
-			zconf::uint64 isize;
-			// prepare input buffer
-			if( _core->_ios != 0 ){
-				// read input buffer
-				if( _core->_zoffset - _core->_izoffset + _core->_izsize >= _core->_csize ){
-					flush = Z_FINISH; isize = _core->_csize - ( _core->_zoffset - _core->_izoffset );
-				}else{
-					isize = _core->_izsize;
-				}
-				_core->_ios->read( _core->_ibuffer, isize );
-			}else{
-				// calculate input buffer size
-				if( _core->_zoffset + _core->_izsize >= _core->_csize ) {
-					flush = Z_FINISH; isize = _core->_csize - _core->_zoffset;
-				}else{
-					isize = _core->_izsize;
-				}
-				// get pointer to buffer
-				_core->_ibuffer = _core->_data + _core->_zoffset;
-			}
-
-			// increase zoffset
-			_core->_zoffset += isize;
-
-			// set zstream
-			_core->_zstream.avail_in  = isize;
-			_core->_zstream.next_in   = reinterpret_cast<Bytef*>( _core->_ibuffer );
-			_core->_zstream.avail_out = _core->_ozsize;
-			_core->_zstream.next_out  = reinterpret_cast<Bytef*>( _core->_obuffer );
-		} // if( _core->_zstream.avail_out > 0 )
-
-		// inflate buffer
-		int ret = inflate( &_core->_zstream, flush );
-
-		// check for errors 2
-		switch ( ret ) {
-			case Z_STREAM_ERROR:{
-				_core->_error = "zstream: internal error";
-				_core->_flags |= ferr; inflateEnd( &_core->_zstream ); return *this;
-			}case Z_NEED_DICT:{
-				_core->_error = "zstream: the entry requires zlib dictionary";
-				_core->_flags |= ferr; inflateEnd( &_core->_zstream ); return *this;
-			}case Z_DATA_ERROR:{
-				_core->_error = "zstream: zlib data error";
-				_core->_flags |= ferr; inflateEnd( &_core->_zstream ); return *this;
-			}case Z_MEM_ERROR:{
-				_core->_error = "zstream: zlib memory error";
-				_core->_flags |= ferr; inflateEnd( &_core->_zstream ); return *this;
-			}
-		}
-
-		// get obtained data size
-		zconf::uint64 have = _core->_ozsize - _core->_zstream.avail_out;
+		zconf::uint64 have, want = nbytes - _core->_gcount;
+		zconf::int32 ret;
 
-		// copy obtained data
-		if( _core->_gcount + have >= nbytes ){
-			zconf::uint64 size = nbytes - _core->_gcount;
-			// copy the final data
-			memcpy( data + _core->_gcount, _core->_obuffer, size );
-			// refresh remaining data values
+		if( want >= ZCDIRECT || ( _core->_csize <= ZCSMALL && want >= _core->_usize - _core->_tcount ) ){
+			// big requests & the whole rest of small streams are inflated straight into the caller's memory
+			if( want > ZCDIRECTMAX ) want = ZCDIRECTMAX;
+			ret = inflates( data + _core->_gcount, want, have );
+			if( _core->_flags & ferr ) return *this;
+			// the data is already in place
+			_core->_gcount += have; _core->_tcount += have;
+		}else{
+			ret = inflates( _core->_obuffer, _core->_ozsize, have );
+			if( _core->_flags & ferr ) return *this;
+			zconf::uint64 size = ( want < have ) ? want : have;
+			// copy obtained data
+			std::memcpy( data + _core->_gcount, _core->_obuffer, size );
+			// the rest is kept for the next read
 			_core->_rndata = have - size; _core->_roffset = have;
 			// refresh gcount
 			_core->_gcount += size; _core->_tcount += size;
-			// check eof
-			if( _core->_tcount >= _core->_usize ) _core->_flags |= feof;
-			// it's done
+		}
+
+		// check the end of the deflate stream
+		if( ( ret == Z_STREAM_END && _core->_rndata == 0 ) || _core->_tcount >= _core->_usize ){
+			_core->_flags |= feof; return *this;
+		}else if( _core->_gcount == nbytes ){
 			return *this; // SUCCESS
-		}else{
-			// copy data
-			memcpy( data + _core->_gcount, _core->_obuffer, have );
-			// refresh gcount
-			_core->_gcount += have; _core->_tcount += have;
 		}
 	}
 }
 
+zstream &zstream::view( const zconf::byte *&data, zconf::uint64 nbytes ){
+	// reset _core->_gcount
+	_core->_gcount = 0; data = 0;
+
+	// check errors and mode
+	if( !readable() ) return *this;
+
+	// stored data is borrowed straight from the source
+	if( _core->_rndata == 0 && ( _core->_flags & fraw ) ){
+		zconf::uint64 size = _core->_csize - ( _core->_zoffset - _core->_izoffset );
+		if( size > nbytes ) size = nbytes;
+		if( _core->_ibuffer != 0 && size > _core->_izsize ) size = _core->_izsize;
+		// go to the actual offset ( the iostream cursor may be shared by many streams )
+		seekoffset(); if( _core->_flags & ferr ) return *this;
+		data = fill( size ); if( data == 0 ) return *this;
+		_core->_crc = zcrc::update( _core->_crc, data, size );
+		_core->_zoffset += size;
+		_core->_gcount = size; _core->_tcount += size;
+		// check eof
+		if( _core->_tcount >= _core->_usize || size == 0 ){
+			_core->_flags |= feof; verify();
+		}
+		return *this;
+	}
+
+	// inflate the next chunk if everything was handed out
+	if( _core->_rndata == 0 ){
+		zconf::int32 ret = Z_OK;
+		zconf::uint64 have = 0;
+		// go to the actual offset ( the iostream cursor may be shared by many streams )
+		seekoffset(); if( _core->_flags & ferr ) return *this;
+		// zlib may need more input before it gives any output
+		while( have == 0 && ret != Z_STREAM_END ){
+			ret = inflates( _core->_obuffer, _core->_ozsize, have );
+			if( _core->_flags & ferr ) return *this;
+		}
+		_core->_rndata = have; _core->_roffset = have;
+		// nothing else to hand out
+		if( have == 0 ){
+			_core->_flags |= feof; return *this;
+		}
+	}
+
+	// borrow the remaining data
+	zconf::uint64 size = ( nbytes < _core->_rndata ) ? nbytes : _core->_rndata;
+	data = _core->_obuffer + _core->_roffset - _core->_rndata;
+	_core->_rndata -= size;
+	_core->_gcount = size; _core->_tcount += size;
+
+	// check eof
+	if( _core->_tcount >= _core->_usize ) _core->_flags |= feof;
+	return *this;
+}
+
+zstream &zstream::copyto( int fd ){
+	// reset _core->_gcount
+	_core->_gcount = 0;
+
+	// check errors and mode
+	if( !readable() ) return *this;
+
+	zconf::uint64 copied = 0;
+	// stored data goes from the source to fd without passing through here
+	if( ( _core->_flags & fraw ) && _core->_src != 0 ){
+		// data already read from the source
+		if( _core->_rndata ){
+			zconf::uint64 size = zsource::writeto( fd, _core->_obuffer + _core->_roffset - _core->_rndata, _core->_rndata );
+			copied += size; _core->_tcount += size; _core->_rndata -= size;
+		}
+		zconf::uint64 left = _core->_csize - ( _core->_zoffset - _core->_izoffset );
+		if( _core->_rndata == 0 && left > 0 ){
+			// mappings can be checked, kernel copies are never seen
+			const zconf::byte *mapped = _core->_src->view( _core->_zoffset, left );
+			if( mapped != 0 ) _core->_crc = zcrc::update( _core->_crc, mapped, left );
+			ZSTAT( zconf::uint64 start = zstats::now(); )
+			if( mapped == 0 && _core->_verify ){
+				// a crc-32 to check, the data goes through the input buffer
+				while( left > 0 ){
+					zconf::uint64 size = _core->_src->pread( _core->_ibuffer, left < _core->_izsize ? left : _core->_izsize, _core->_zoffset );
+					if( size == 0 ) break;
+					_core->_crc = zcrc::update( _core->_crc, _core->_ibuffer, size );
+					if( zsource::writeto( fd, _core->_ibuffer, size ) != size ){
+						_core->_error = "zstream: wasn't able to write to the file descriptor";
+						_core->_flags |= ferr; break;
+					}
+					ZSTAT( _core->_stats.bytes_in += size; _core->_stats.bytes_out += size; )
+					copied += size; _core->_tcount += size; _core->_zoffset += size; left -= size;
+				}
+			}else{
+				zconf::uint64 size = _core->_src->copyto( fd, left, _core->_zoffset );
+				ZSTAT( _core->_stats.bytes_in += size; _core->_stats.bytes_out += size; )
+				copied += size; _core->_tcount += size; _core->_zoffset += size;
+			}
+			ZSTAT( _core->_stats.io_ns += zstats::now() - start; )
+		}
+		if( !( _core->_flags & ferr ) && _core->_tcount < _core->_usize ){
+			_core->_error = "zstream: wasn't able to copy the stored data";
+			_core->_flags |= ferr;
+		}else if( !( _core->_flags & ferr ) ){
+			_core->_flags |= feof; verify();
+		}
+	}else{
+		const zconf::byte *data;
+		// write every chunk as it's inflated
+		while( !( _core->_flags & ( feof | ferr ) ) ){
+			view( data );
+			if( zsource::writeto( fd, data, _core->_gcount ) != _core->_gcount ){
+				_core->_error = "zstream: wasn't able to write to the file descriptor";
+				_core->_flags |= ferr;
+			}
+			copied += _core->_gcount;
+		}
+	}
+	_core->_gcount = copied;
+	return *this;
+}
+
 zstream &zstream::write( const zconf::cbytep data, zconf::uint64 nbytes ){
 	// reset _core->_gcount
 	_core->_gcount = 0;
 
 	// check end of file
-	if( _core->_flags & feof || ( _core->_ios == 0 && _core->_data == 0 ) ) {
+	if( _core->_flags & feof || !is_open() ) {
 		return *this;
 	}
 	// check mode
@@ -395,38 +698,66 @@ zstream &zstream::write( const zconf::cbytep data, zconf::uint64 nbytes ){
 		_core->_flags |= ferr; return *this;
 	}
 
-	// go to the actual offset ( for multithreading over the same iostream )
+	// go to the actual offset ( the iostream cursor may be shared by many streams )
 	seekoffset(); if( _core->_flags & ferr ) return *this;
 
+	// stored data is written as it is
+	if( _core->_flags & fraw ){
+		if( !drain( nbytes, data ) ) return *this;
+		_core->_crc = zcrc::update( _core->_crc, data, nbytes );
+		_core->_gcount = nbytes; _core->_tcount += nbytes; _core->_zoffset += nbytes;
+		ZSTAT( _core->_stats.bytes_out += nbytes; )
+		return *this;
+	}
+
+	// big entries are compressed by blocks on many threads
+	if( _core->_threads > 1 ){
+		if( _core->_pool == 0 ){
+			_core->_pool = new zpool( _core->_threads );
+			_core->_blocks.resize( _core->_threads * 2 );
+		}
+		zconf::uint64 done = 0;
+		while( done < nbytes ){
+			zblock &block = _core->_blocks[ _core->_nblocks ];
+			zconf::uint64 size = _core->_bsize - block._input.size();
+			if( size > nbytes - done ) size = nbytes - done;
+			block._input.append( data + done, size ); done += size;
+			// compress when every block is full
+			if( block._input.size() == _core->_bsize && ++_core->_nblocks == _core->_blocks.size() ){
+				if( !deflates( false ) ) return *this;
+			}
+		}
+		_core->_gcount = nbytes; _core->_tcount += nbytes;
+		ZSTAT( _core->_stats.bytes_out += nbytes; )
+		return *this;
+	}
+
 	// zstream input
-	_core->_zstream.avail_in = nbytes;
-	_core->_zstream.next_in  = reinterpret_cast<Bytef*>( data );
+	_core->_zstream->avail_in = nbytes;
+	_core->_zstream->next_in  = reinterpret_cast<Bytef*>( data );
 
 	do{
 		// zstream output
-		_core->_zstream.avail_out = _core->_ozsize;
-		_core->_zstream.next_out  = reinterpret_cast<Bytef*>( _core->_obuffer );
+		_core->_zstream->avail_out = _core->_ozsize;
+		_core->_zstream->next_out  = reinterpret_cast<Bytef*>( _core->_obuffer );
 		// deflate stream
-		if( deflate( &_core->_zstream, Z_NO_FLUSH ) == Z_STREAM_ERROR ){
+		ZSTAT( zconf::uint64 start = zstats::now(); )
+		zconf::int32 ret = deflate( _core->_zstream, Z_NO_FLUSH );
+		ZSTAT( _core->_stats.deflates++; _core->_stats.zlib_ns += zstats::now() - start; )
+		if( ret == Z_STREAM_ERROR ){
 			_core->_error = "zstream: zlib error";
 			_core->_flags |= ferr; return *this;
 		}
 		// write the result
-		zconf::uint64 have = _core->_ozsize -_core->_zstream.avail_out;
-		if( _core->_ios != 0 ){
-			_core->_ios->write( reinterpret_cast<zconf::bytep>( _core->_obuffer ), have );
-		}else{
-			// check boundaries
-			if( _core->_zoffset - _core->_izoffset + have >= _core->_csize  ){
-				_core->_error = "zstream: overflow of data buffer";
-				_core->_flags |= ferr; return *this;
-			}
-			// memory copy
-			std::memcpy( _core->_data + _core->_zoffset, _core->_obuffer, have );
-		}
-		// number of bytes written
-		_core->_gcount += nbytes; _core->_tcount += nbytes; _core->_zoffset += have;
-	}while( _core->_zstream.avail_out == 0 );
+		zconf::uint64 have = _core->_ozsize -_core->_zstream->avail_out;
+		if( !drain( have ) ) return *this;
+		_core->_zoffset += have;
+	}while( _core->_zstream->avail_out == 0 );
+
+	// number of bytes written
+	_core->_crc = zcrc::update( _core->_crc, data, nbytes );
+	_core->_gcount = nbytes; _core->_tcount += nbytes;
+	ZSTAT( _core->_stats.bytes_out += nbytes; )
 
 	// return object
 	return *this;
@@ -437,7 +768,7 @@ zstream &zstream::flush( void ){
 	_core->_gcount = 0;
 
 	// check end of file
-	if( _core->_flags & feof || ( _core->_ios == 0 && _core->_data == 0 ) ) {
+	if( _core->_flags & feof || !is_open() ) {
 		return *this;
 	}
 	// check mode
@@ -446,49 +777,440 @@ zstream &zstream::flush( void ){
 		_core->_flags |= ferr; return *this;
 	}
 
-	// go to the actual offset ( for multithreading over the same iostream )
+	// stored data has nothing pending
+	if( _core->_flags & fraw ){
+		_core->_flags |= feof; return *this;
+	}
+
+	// the last blocks close the stream
+	if( _core->_pool != 0 ){
+		if( deflates( true ) ) _core->_flags |= feof;
+		return *this;
+	}
+
+	// go to the actual offset ( the iostream cursor may be shared by many streams )
 	seekoffset(); if( _core->_flags & ferr ) return *this;
 
 	// zstream input
-	_core->_zstream.avail_in = 0;
-	_core->_zstream.next_in  = 0;
+	_core->_zstream->avail_in = 0;
+	_core->_zstream->next_in  = 0;
 
 	// flush zstream contents
 	do{
 		// zstream output
-		_core->_zstream.avail_out = _core->_ozsize;
-		_core->_zstream.next_out  = reinterpret_cast<Bytef*>( _core->_obuffer );
+		_core->_zstream->avail_out = _core->_ozsize;
+		_core->_zstream->next_out  = reinterpret_cast<Bytef*>( _core->_obuffer );
 		// deflate the rest of the stream
-		if( deflate( &_core->_zstream, Z_FINISH ) == Z_STREAM_ERROR ){
+		ZSTAT( zconf::uint64 start = zstats::now(); )
+		zconf::int32 ret = deflate( _core->_zstream, Z_FINISH );
+		ZSTAT( _core->_stats.deflates++; _core->_stats.zlib_ns += zstats::now() - start; )
+		if( ret == Z_STREAM_ERROR ){
 			_core->_error = "zstream: zlib error";
 			_core->_flags |= ferr; return *this;
 		}
 		// write the result
-		zconf::uint64 have = _core->_ozsize -_core->_zstream.avail_out;
-		if( _core->_ios != 0 ){
-			_core->_ios->write( reinterpret_cast<zconf::bytep>( _core->_obuffer ), have );
+		zconf::uint64 have = _core->_ozsize -_core->_zstream->avail_out;
+		if( !drain( have ) ) return *this;
+		// number of bytes written
+		_core->_zoffset += have;
+	} while( _core->_zstream->avail_out == 0 );
+
+	// the deflate stream is finished
+	_core->_flags |= feof;
+	// return reference
+	return *this;
+}
+
+zstream &zstream::seekg( zconf::uint64 offset ){
+	// reset _core->_gcount
+	_core->_gcount = 0;
+
+	// check errors and mode
+	if( !is_open() || ( _core->_flags & ferr ) ){
+		return *this;
+	}else if( _core->_flags & fwio ){
+		_core->_error = "zstream: only streams set to read can seek";
+		_core->_flags |= ferr; return *this;
+	}
+	if( offset > _core->_usize ) offset = _core->_usize;
+	_core->_flags &= ~feof;
+
+	// stored data is just moved ( the crc-32 can't be checked anymore )
+	if( _core->_flags & fraw ){
+		_core->_verify = false;
+		_core->_zoffset = _core->_izoffset + offset;
+		_core->_tcount = offset; _core->_rndata = 0;
+		return *this;
+	}
+	// the offset is in the inflated buffer
+	if( offset >= _core->_tcount && offset <= _core->_tcount + _core->_rndata ){
+		_core->_rndata -= offset - _core->_tcount; _core->_tcount = offset;
+		return *this;
+	}
+
+	// seeks build the index on demand
+	if( _core->_index.span() == 0 ) _core->_index.setspan( ZCSPAN );
+	// go back, or jump ahead if there's an access point after the inflated data
+	zconf::int64 point = _core->_index.find( offset );
+	if( offset < _core->_tcount || ( point >= 0 && _core->_index.uoffset( point ) > _core->_inflated ) ){
+		if( !restore( point ) ) return *this;
+	}
+
+	// inflate up to the offset
+	const zconf::byte *data;
+	while( _core->_tcount < offset && !( _core->_flags & ( feof | ferr ) ) ){
+		view( data, offset - _core->_tcount );
+	}
+	_core->_gcount = 0;
+	// return reference
+	return *this;
+}
+
+zindex &zstream::index( void ){
+	return _core->_index;
+}
+
+bool zstream::restore( zconf::int64 point ){
+	const zindex &index = _core->_index;
+	_core->_zstream->avail_in = 0; _core->_rndata = 0;
+	ZSTAT( _core->_stats.seeks++; )
+	// start over
+	if( point < 0 ){
+		inflateReset2( _core->_zstream, state_wbits( _core->_kind ) ); _core->_crc = 0;
+		_core->_zoffset = _core->_izoffset; _core->_window.clear();
+		_core->_tcount = _core->_inflated = 0;
+		return true;
+	}
+	// access points are always inside raw deflate data ( the crc-32 can't be checked anymore )
+	inflateReset2( _core->_zstream, -MAX_WBITS );
+	_core->_verify = false;
+	_core->_zoffset = _core->_izoffset + index.coffset( point );
+	// the first bits are in the previous byte
+	if( index.bits( point ) ){
+		zconf::byte prime;
+		_core->_zoffset--;
+		seekoffset(); if( _core->_flags & ferr ) return false;
+		if( fill( 1, &prime ) == 0 ) return false;
+		_core->_zoffset++;
+		inflatePrime( _core->_zstream, index.bits( point ),
+			static_cast<zconf::uint8>( prime ) >> ( 8 - index.bits( point ) ) );
+	}
+	// the window of the access point
+	_core->_window = index.window( point );
+	inflateSetDictionary( _core->_zstream,
+		reinterpret_cast<const Bytef*>( _core->_window.data() ), _core->_window.size() );
+	_core->_tcount = _core->_inflated = index.uoffset( point );
+	// seek from here
+	seekoffset();
+	return !( _core->_flags & ferr );
+}
+
+zstream &zstream::setthreads( zconf::uint32 threads, zconf::uint64 bsize ){
+	if( _core->_tcount > 0 || _core->_pool != 0 ){
+		_core->_error = "zstream: the threads must be set before writing";
+		_core->_flags |= ferr; return *this;
+	}
+	// set parallel deflate values
+	_core->_threads = threads; _core->_bsize = bsize > 0 ? bsize : ZCPBSIZE;
+	// return reference
+	return *this;
+}
+
+zstream &zstream::setreadahead( zconf::uint32 depth ){
+	if( _core->_flags & fwio ){
+		_core->_error = "zstream: only streams set to read can read ahead";
+		_core->_flags |= ferr; return *this;
+	}
+	// zlib may be using a chunk of the reader
+	if( _core->_ahead != 0 ){
+		_core->_error = "zstream: the read ahead must be set before reading";
+		_core->_flags |= ferr; return *this;
+	}
+	_core->_depth = depth;
+	// return reference
+	return *this;
+}
+
+zconf::uint32 zstream::crc( void ) const{
+	return _core->_crc;
+}
+
+zstats zstream::stats( void ) const{
+#ifdef ZSTATS
+	return _core->_stats;
+#else
+	return zstats();
+#endif
+}
+
+zstream &zstream::setcrc( zconf::uint32 crc ){
+	_core->_ecrc = crc; _core->_verify = ( _core->_flags & frio ) && _core->_tcount == 0;
+	// return reference
+	return *this;
+}
+
+void zstream::verify( void ){
+	if( _core->_verify && _core->_crc != _core->_ecrc ){
+		_core->_error = "zstream: crc-32 mismatch";
+		_core->_flags |= ferr;
+	}
+	// only once
+	_core->_verify = false;
+}
+
+bool zstream::deflates( bool last ){
+	// the last block may be partial or even empty
+	zconf::uint64 n = _core->_nblocks + ( last ? 1 : 0 );
+	ZSTAT( zconf::uint64 start = zstats::now(); )
+	// every block continues the window of the previous one
+	for( zconf::uint64 i = 0; i < n; i++ ){
+		zblock &block = _core->_blocks[i];
+		block._dict = _core->_dict; block._last = last && i + 1 == n;
+		if( block._input.size() >= ZWSIZE ){
+			_core->_dict.assign( block._input, block._input.size() - ZWSIZE, ZWSIZE );
 		}else{
-			// check boundaries
-			if( _core->_zoffset - _core->_izoffset + have >= _core->_csize  ){
-				_core->_error = "zstream: overflow of data buffer";
-				_core->_flags |= ferr; return *this;
-			}
-			// memory copy
-			std::memcpy( _core->_data + _core->_zoffset, _core->_obuffer, have );
+			_core->_dict.append( block._input );
+			if( _core->_dict.size() > ZWSIZE ) _core->_dict.erase( 0, _core->_dict.size() - ZWSIZE );
 		}
-		// number of bytes written
+		zconf::int32 level = _core->_level;
+		const zhooks &hooks = _core->_hooks;
+		_core->_pool->push( [&block, level, &hooks](){ deflate_block( block, level, hooks ); } );
+	}
+	_core->_pool->wait();
+	ZSTAT( _core->_stats.deflates += n; _core->_stats.zlib_ns += zstats::now() - start; )
+
+	// go to the actual offset ( the iostream cursor may be shared by many streams )
+	seekoffset(); if( _core->_flags & ferr ) return false;
+
+	// write the blocks in order
+	for( zconf::uint64 i = 0; i < n; i++ ){
+		zblock &block = _core->_blocks[i];
+		if( block._ret == Z_STREAM_ERROR || block._ret == Z_MEM_ERROR ){
+			_core->_error = "zstream: zlib error";
+			_core->_flags |= ferr; return false;
+		}
+		if( !drain( block._output.size(), block._output.data() ) ) return false;
+		_core->_zoffset += block._output.size();
+		_core->_crc = crc32_combine( _core->_crc, block._crc, block._input.size() );
+		block._input.clear();
+	}
+	_core->_nblocks = 0;
+	return true;
+}
+
+bool zstream::readable( void ){
+	// set EOF
+	if( _core->_tcount >= _core->_usize ) _core->_flags |= feof;
+
+	// check errors
+	if( !is_open() ) {
+		return false;
+	}else if( _core->_flags & ( feof | ferr ) ){
+		return false;
+	}
+
+	// check mode
+	if( _core->_flags & fwio ){
+		_core->_error = "zstream: is set to read into the buffer";
+		_core->_flags |= ferr; return false;
+	}
+	return true;
+}
+
+zconf::int32 zstream::inflates( zconf::bytep output, zconf::uint64 osize, zconf::uint64 &have ){
+	zconf::int32 flush = Z_NO_FLUSH;
+	zconf::uint64 consumed = _core->_zoffset - _core->_izoffset;
+	have = 0;
+	// stored data is copied as it is
+	if( _core->_flags & fraw ){
+		have = _core->_csize - consumed;
+		if( have > osize ) have = osize;
+		if( have > 0 && fill( have, output ) == 0 ) return Z_ERRNO;
+		_core->_crc = zcrc::update( _core->_crc, output, have );
 		_core->_zoffset += have;
-	} while( _core->_zstream.avail_out == 0 );
+		ZSTAT( _core->_stats.bytes_out += have; )
+		if( consumed + have < _core->_csize ) return Z_OK;
+		verify(); return Z_STREAM_END;
+	}
+	// refill the input once zlib has consumed it
+	if( _core->_zstream->avail_in == 0 && consumed < _core->_csize ){
+		zconf::uint64 isize = _core->_csize - consumed;
+		// calculate input buffer size
+		if( isize > _core->_izsize ) isize = _core->_izsize;
+		// prepare input buffer
+		const zconf::byte *input = fill( isize );
+		if( input == 0 ) return Z_ERRNO;
+
+		// increase zoffset
+		_core->_zoffset += isize; consumed += isize;
+
+		// set zstream
+		_core->_zstream->avail_in  = isize;
+		_core->_zstream->next_in   = reinterpret_cast<Bytef*>( const_cast<zconf::bytep>( input ) );
+	}
+	// the last chunk of compressed data is in the zstream
+	if( consumed >= _core->_csize ) flush = Z_FINISH;
 
+	// set output
+	_core->_zstream->avail_out = osize;
+	_core->_zstream->next_out  = reinterpret_cast<Bytef*>( output );
+
+	// inflate buffer ( stop on block boundaries if it's indexing )
+	bool indexing = _core->_index.span() > 0;
+	ZSTAT( zconf::uint64 start = zstats::now(); )
+	int ret = inflate( _core->_zstream, indexing ? Z_BLOCK : flush );
+	ZSTAT( _core->_stats.inflates++; _core->_stats.zlib_ns += zstats::now() - start; )
+
+	// check for errors
+	switch ( ret ) {
+		case Z_STREAM_ERROR:{
+			_core->_error = "zstream: internal error";
+			_core->_flags |= ferr; inflateEnd( _core->_zstream ); return ret;
+		}case Z_NEED_DICT:{
+			_core->_error = "zstream: the entry requires zlib dictionary";
+			_core->_flags |= ferr; inflateEnd( _core->_zstream ); return ret;
+		}case Z_DATA_ERROR:{
+			_core->_error = "zstream: zlib data error";
+			_core->_flags |= ferr; inflateEnd( _core->_zstream ); return ret;
+		}case Z_MEM_ERROR:{
+			_core->_error = "zstream: zlib memory error";
+			_core->_flags |= ferr; inflateEnd( _core->_zstream ); return ret;
+		}
+	}
+
+	// get obtained data size
+	have = osize - _core->_zstream->avail_out;
+	_core->_inflated += have;
+	ZSTAT( _core->_stats.bytes_out += have; )
+	_core->_crc = zcrc::update( _core->_crc, output, have );
+	if( ret == Z_STREAM_END ) verify();
+
+	// keep the window and take an access point on block boundaries
+	if( indexing ){
+		std::string &window = _core->_window;
+		if( have >= ZWSIZE ){
+			window.assign( output + have - ZWSIZE, ZWSIZE );
+		}else{
+			window.append( output, have );
+			if( window.size() > 2 * ZWSIZE ) window.erase( 0, window.size() - ZWSIZE );
+		}
+		zconf::uint64 last = _core->_index.size() ? _core->_index.uoffset( _core->_index.size() - 1 ) : 0;
+		zconf::uint64 wsize = window.size() < ZWSIZE ? window.size() : ZWSIZE;
+		if( ( _core->_zstream->data_type & 128 ) && !( _core->_zstream->data_type & 64 ) &&
+			_core->_inflated >= last + _core->_index.span() &&
+			wsize >= ( _core->_inflated < ZWSIZE ? _core->_inflated : ZWSIZE ) ){
+			_core->_index.add( _core->_inflated, consumed - _core->_zstream->avail_in,
+				_core->_zstream->data_type & 7, window.data() + window.size() - wsize, wsize );
+		}
+	}
+
+	// there's no more compressed data
+	if( ret == Z_BUF_ERROR && flush == Z_FINISH && have == 0 ){
+		_core->_error = "zstream: unexpected end of compressed data";
+		_core->_flags |= ferr;
+	}
+	return ret;
+}
+
+const zconf::byte *zstream::fill( zconf::uint64 isize, zconf::bytep output ){
+	ZSTAT( _core->_stats.refills++; _core->_stats.bytes_in += isize; )
+	ZSTAT( zconf::uint64 start = zstats::now(); )
+	if( _core->_data != 0 ){
+		// memory is inflated in place
+		if( output == 0 ) return _core->_data + _core->_zoffset;
+		std::memcpy( output, _core->_data + _core->_zoffset, isize );
+		return output;
+	}else if( _core->_src != 0 ){
+		// mapped sources are inflated in place
+		const zconf::byte *input = _core->_src->view( _core->_zoffset, isize );
+		if( input != 0 && output == 0 ) return input;
+		// mappings have no input buffer to read into
+		if( input == 0 && _core->_src->is_mapped() ){
+			_core->_error = "zstream: wasn't able to read the compressed data";
+			_core->_flags |= ferr; return 0;
+		}
+		// compressed chunks can be read ahead, only when there's more than one
+		if( output == 0 && _core->_depth > 0 && !( _core->_flags & fraw ) ){
+			zconf::uint64 end = _core->_izoffset + _core->_csize;
+			if( _core->_ahead == 0 && end - _core->_zoffset > _core->_izsize ){
+				_core->_ahead = new zahead( *_core->_src, _core->_depth, _core->_izsize, end );
+			}
+			if( _core->_ahead != 0 ){
+				input = _core->_ahead->take( _core->_zoffset, isize );
+				ZSTAT( _core->_stats.io_ns += zstats::now() - start; )
+				if( input != 0 ) return input;
+				_core->_error = "zstream: wasn't able to read the compressed data";
+				_core->_flags |= ferr; return 0;
+			}
+		}
+		if( output == 0 ) output = _core->_ibuffer;
+		// positional read, there's no shared cursor
+		zconf::uint64 size = _core->_src->pread( output, isize, _core->_zoffset );
+		ZSTAT( _core->_stats.io_ns += zstats::now() - start; )
+		if( size == isize ) return output;
+	}else{
+		if( output == 0 ) output = _core->_ibuffer;
+		// read input buffer
+		_core->_ios->read( output, isize );
+		ZSTAT( _core->_stats.io_ns += zstats::now() - start; )
+		if( static_cast<zconf::uint64>( _core->_ios->gcount() ) == isize ) return output;
+	}
+	_core->_error = "zstream: wasn't able to read the compressed data";
+	_core->_flags |= ferr; return 0;
+}
+
+bool zstream::drain( zconf::uint64 have, const zconf::byte *output ){
+	if( output == 0 ) output = _core->_obuffer;
+	ZSTAT( _core->_stats.bytes_in += have; )
+	ZSTAT( zconf::uint64 start = zstats::now(); )
+	if( _core->_ios != 0 ){
+		_core->_ios->write( output, have );
+		ZSTAT( _core->_stats.io_ns += zstats::now() - start; )
+	}else if( _core->_src != 0 ){
+		// the space after csize belongs to someone else
+		if( _core->_zoffset - _core->_izoffset + have > _core->_csize ){
+			_core->_error = "zstream: overflow of the reserved space";
+			_core->_flags |= ferr; return false;
+		}
+		// positional write, there's no shared cursor
+		zconf::uint64 size = _core->_src->pwrite( output, have, _core->_zoffset );
+		ZSTAT( _core->_stats.io_ns += zstats::now() - start; )
+		if( size != have ){
+			_core->_error = "zstream: wasn't able to write the compressed data";
+			_core->_flags |= ferr; return false;
+		}
+	}else{
+		// check boundaries
+		if( _core->_zoffset - _core->_izoffset + have > _core->_csize  ){
+			_core->_error = "zstream: overflow of data buffer";
+			_core->_flags |= ferr; return false;
+		}
+		// memory copy
+		std::memcpy( _core->_data + _core->_zoffset, output, have );
+	}
+	return true;
+}
+
+zstream &zstream::setalloc( alloc_func zalloc, free_func zfree, voidpf opaque ){
+	if( is_open() ){
+		_core->_error = "zstream: is already open";
+		 _core->_flags |= ferr;
+		 return *this;
+	}
+	// zlib hooks of the next openings
+	_core->_hooks._zalloc = zalloc; _core->_hooks._zfree = zfree; _core->_hooks._opaque = opaque;
 	// return reference
 	return *this;
 }
 
 zstream &zstream::setbs( zconf::uint64 ibs, zconf::uint64 obs ){
-	if( _core->_ios != 0 || _core->_data != 0 ){
+	if( is_open() ){
 		_core->_error = "zstream: is already open";
 		 _core->_flags |= ferr;
 	}
-	// set buffer sizes
-	_core->_izsize = ibs; _core->_ozsize = obs;
+	// largest buffer sizes, the next opening fits them to the stream ( 0 keeps the current one )
+	if( ibs > 0 ) _core->_ibs = ibs;
+	if( obs > 0 ) _core->_obs = obs;
+	// return reference
+	return *this;
 }
@@ -18,6 +18,9 @@
 #define ZSTREAM_H_
 
 #include "zconf.h"
+#include "zsource.h"
+#include "zindex.h"
+#include "zstats.h"
 
 /**
  * @author Víctor Egea Hernando, egea.hernando@gmail.com
@@ -28,10 +31,22 @@
  * how you should feed zlib to get the chunk of data you want, the
  * data its required to zlib, stored and managed automatically
  * <br /><br />
- * zstream doen't offer you random access to the stream, this
- * must be sequential, so it doesn't offer you 'seekp' or 'seekp'
+ * zstream doen't offer you random access to the written stream, but
+ * a read stream can 'seekg': the first seeks inflate the stream and
+ * keep access points every ZCSPAN bytes, later seeks resume from the
+ * nearest access point
  * <br /><br />
- * raw data compression is given with the 'fzip' flag up
+ * raw data compression is given with the 'fzip' flag up, and stored
+ * data ( no compression at all ) with the 'fraw' flag up
+ * <br /><br />
+ * big streams can be compressed by blocks on many threads, each block
+ * ends on a byte boundary and uses the tail of the previous one as its
+ * dictionary, so the result is still one deflate stream
+ * <br /><br />
+ * over a zsource the stream reads and writes at its own offset, so
+ * many zstreams can share the same file from different threads; a read
+ * stream over a zsource can read its compressed data ahead on another
+ * thread, so the i/o of the next chunks overlaps the inflate of this one
  * <br /><br />
  * there are alternative in the boost libreary for example, but the
  * idea of this system is to make something simple and not depend on
@@ -44,14 +59,21 @@ public:
 	zstream( void );
 	// constructor 1
 	zstream( zconf::bytep data,
-		zconf::uint32 csize,
-		zconf::uint32 usize,
+		zconf::uint64 csize,
+		zconf::uint64 usize,
 		zconf::uint32 flags = frio,
 		zconf::int32 level = Z_DEFAULT_COMPRESSION );
 	// constructor 2
 	zstream( std::iostream &ios,
-		zconf::uint32 csize,
-		zconf::uint32 usize,
+		zconf::uint64 csize,
+		zconf::uint64 usize,
+		zconf::uint64 offset = 0,
+		zconf::uint32 flags = frio,
+		zconf::int32 level = Z_DEFAULT_COMPRESSION );
+	// constructor 3
+	zstream( zsource &src,
+		zconf::uint64 csize,
+		zconf::uint64 usize,
 		zconf::uint64 offset = 0,
 		zconf::uint32 flags = frio,
 		zconf::int32 level = Z_DEFAULT_COMPRESSION );
@@ -61,20 +83,34 @@ public:
 public:
 	// open from buffer
 	zstream &open( zconf::bytep data,
-		zconf::uint32 csize,
-		zconf::uint32 usize,
+		zconf::uint64 csize,
+		zconf::uint64 usize,
 		zconf::uint32 flags = frio,
 		zconf::int32 level = Z_DEFAULT_COMPRESSION );
 	// open from iostream
 	zstream &open( std::iostream &ios,
-		zconf::uint32 csize,
-		zconf::uint32 usize,
+		zconf::uint64 csize,
+		zconf::uint64 usize,
+		zconf::uint64 offset = 0,
+		zconf::uint32 flags = frio,
+		zconf::int32 level = Z_DEFAULT_COMPRESSION );
+	// open from positional source
+	zstream &open( zsource &src,
+		zconf::uint64 csize,
+		zconf::uint64 usize,
 		zconf::uint64 offset = 0,
 		zconf::uint32 flags = frio,
 		zconf::int32 level = Z_DEFAULT_COMPRESSION );
-	// set buffer sizes
+	// set the largest buffer sizes, kept for the next openings ( before opening )
 	zstream &setbs( zconf::uint64 ibs = ZCOBSIZE,
 		zconf::uint64 obs = ZCIBSIZE );
+	// allocate the zlib states with zalloc & zfree ( Z_NULL for the heap, before opening )
+	zstream &setalloc( alloc_func zalloc, free_func zfree, voidpf opaque );
+	// compress by blocks on n threads ( before writing )
+	zstream &setthreads( zconf::uint32 threads,
+		zconf::uint64 bsize = ZCPBSIZE );
+	// read the compressed data ahead on another thread, depth chunks ( 0 disables, read streams )
+	zstream &setreadahead( zconf::uint32 depth = ZCAHEAD );
 	// close stream if necessary
 	zstream &close( void );
 	// tell us if buffer is open
@@ -83,6 +119,12 @@ public:
 public:
 	// read n bytes and allocate them on data
 	zstream &read( zconf::cbytep data, zconf::uint64 nbytes );
+	// borrow up to n bytes of the internal buffer, valid until the next call
+	zstream &view( const zconf::byte *&data, zconf::uint64 nbytes = ZCOBSIZE );
+	// go to an uncompressed offset ( read streams only )
+	zstream &seekg( zconf::uint64 offset );
+	// copy the rest of the stream to the cursor of fd
+	zstream &copyto( int fd );
 	// write n bytes on data
 	zstream &write( zconf::cbytep data, zconf::uint64 nbytes );
 	// flush remaining data
@@ -101,6 +143,14 @@ public:
 	zconf::uint32 flags( void ) const;
 	// end of zstream input
 	bool eof( void ) const;
+	// crc-32 of the uncompressed data treated
+	zconf::uint32 crc( void ) const;
+	// access points of the stream
+	zindex &index( void );
+	// check the crc-32 at the end of the stream ( read streams, before reading )
+	zstream &setcrc( zconf::uint32 crc );
+	// counters since the opening ( empty without ZSTATS )
+	zstats stats( void ) const;
 
 private:
 	// class core structure declaration
@@ -113,6 +163,20 @@ private:
 	void inits( zconf::int32 level );
 	// seek to offset
 	void seekoffset( void );
+	// check that the stream can be read
+	bool readable( void );
+	// inflate once into output, have is the amount of data obtained
+	zconf::int32 inflates( zconf::bytep output, zconf::uint64 osize, zconf::uint64 &have );
+	// compress the pending blocks on the pool and write them in order
+	bool deflates( bool last );
+	// resume inflate from an access point ( -1 starts over )
+	bool restore( zconf::int64 point );
+	// compare the crc-32 with the expected one
+	void verify( void );
+	// get isize bytes of compressed data at the offset ( into output if given )
+	const zconf::byte *fill( zconf::uint64 isize, zconf::bytep output = 0 );
+	// put have bytes of compressed data at the offset ( from output if given )
+	bool drain( zconf::uint64 have, const zconf::byte *output = 0 );
 
 public:
 	// class flags
@@ -121,6 +185,7 @@ public:
 	static const zconf::uint32 feof    = 0x04; // end of buffer
 	static const zconf::uint32 ferr    = 0x08; // error happened
 	static const zconf::uint32 fzip    = 0x10; // zip entry stream
+	static const zconf::uint32 fraw    = 0x20; // stored data, no compression
 
 };
 